@@ -0,0 +1,174 @@
+#include "stdio.h"
+#include "stdlib.h"
+
+#include "alloc_track.h"
+
+static AllocCounts counts;
+
+#define COUNT(field) __atomic_fetch_add(&counts.field, 1, __ATOMIC_RELAXED)
+
+#if defined(__GLIBC__)
+
+extern void *__libc_malloc(size_t sz);
+extern void *__libc_calloc(size_t n, size_t sz);
+extern void *__libc_realloc(void *p, size_t sz);
+extern void __libc_free(void *p);
+
+void *malloc(size_t sz)
+{
+  COUNT(allocs);
+  return __libc_malloc(sz);
+}
+
+void *calloc(size_t n, size_t sz)
+{
+  COUNT(allocs);
+  return __libc_calloc(n, sz);
+}
+
+void *realloc(void *p, size_t sz)
+{
+  COUNT(allocs);
+  return __libc_realloc(p, sz);
+}
+
+void free(void *p)
+{
+  if (p)
+    COUNT(frees);
+  __libc_free(p);
+}
+
+void init_alloc_tracking(void)
+{
+}
+
+#elif defined(__APPLE__)
+
+#include "mach/mach.h"
+#include "malloc/malloc.h"
+
+// malloc and friends all go through the default zone's function pointers,
+// so wrapping those counts the editor, SDL and SDL_ttf alike
+static void *(*zone_malloc)(malloc_zone_t *z, size_t sz);
+static void *(*zone_calloc)(malloc_zone_t *z, size_t n, size_t sz);
+static void *(*zone_valloc)(malloc_zone_t *z, size_t sz);
+static void *(*zone_realloc)(malloc_zone_t *z, void *p, size_t sz);
+static void (*zone_free)(malloc_zone_t *z, void *p);
+
+static void *counted_malloc(malloc_zone_t *z, size_t sz)
+{
+  COUNT(allocs);
+  return zone_malloc(z, sz);
+}
+
+static void *counted_calloc(malloc_zone_t *z, size_t n, size_t sz)
+{
+  COUNT(allocs);
+  return zone_calloc(z, n, sz);
+}
+
+static void *counted_valloc(malloc_zone_t *z, size_t sz)
+{
+  COUNT(allocs);
+  return zone_valloc(z, sz);
+}
+
+static void *counted_realloc(malloc_zone_t *z, void *p, size_t sz)
+{
+  COUNT(allocs);
+  return zone_realloc(z, p, sz);
+}
+
+static void counted_free(malloc_zone_t *z, void *p)
+{
+  if (p)
+    COUNT(frees);
+  zone_free(z, p);
+}
+
+// the zone is read only once malloc is set up, unprotect it for the swap
+void init_alloc_tracking(void)
+{
+  malloc_zone_t *z = malloc_default_zone();
+  vm_address_t page = (vm_address_t)z & ~(vm_page_size - 1);
+  vm_size_t len = (vm_address_t)z + sizeof(malloc_zone_t) - page;
+  if (vm_protect(mach_task_self(), page, len, 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS)
+  {
+    fprintf(stderr, "alloc tracking: default malloc zone is not writable\n");
+    return;
+  }
+  zone_malloc = z->malloc;
+  zone_calloc = z->calloc;
+  zone_valloc = z->valloc;
+  zone_realloc = z->realloc;
+  zone_free = z->free;
+  z->malloc = counted_malloc;
+  z->calloc = counted_calloc;
+  z->valloc = counted_valloc;
+  z->realloc = counted_realloc;
+  z->free = counted_free;
+  vm_protect(mach_task_self(), page, len, 0, VM_PROT_READ);
+}
+
+#else
+
+static SDL_malloc_func sdl_malloc;
+static SDL_calloc_func sdl_calloc;
+static SDL_realloc_func sdl_realloc;
+static SDL_free_func sdl_free;
+
+static void *counted_malloc(size_t sz)
+{
+  COUNT(allocs);
+  return sdl_malloc(sz);
+}
+
+static void *counted_calloc(size_t n, size_t sz)
+{
+  COUNT(allocs);
+  return sdl_calloc(n, sz);
+}
+
+static void *counted_realloc(void *p, size_t sz)
+{
+  COUNT(allocs);
+  return sdl_realloc(p, sz);
+}
+
+static void counted_free(void *p)
+{
+  if (p)
+    COUNT(frees);
+  sdl_free(p);
+}
+
+// has to run before SDL_Init so nothing SDL owns crosses allocators
+void init_alloc_tracking(void)
+{
+  SDL_GetMemoryFunctions(&sdl_malloc, &sdl_calloc, &sdl_realloc, &sdl_free);
+  SDL_SetMemoryFunctions(counted_malloc, counted_calloc, counted_realloc, counted_free);
+}
+
+#endif
+
+void get_alloc_counts(AllocCounts *out)
+{
+  out->allocs = __atomic_load_n(&counts.allocs, __ATOMIC_RELAXED);
+  out->frees = __atomic_load_n(&counts.frees, __ATOMIC_RELAXED);
+  out->textures_created = counts.textures_created;
+  out->textures_destroyed = counts.textures_destroyed;
+}
+
+void track_texture_create(void)
+{
+  counts.textures_created++;
+}
+
+void destroy_texture(SDL_Texture *t)
+{
+  if (!t)
+    return;
+  counts.textures_destroyed++;
+  SDL_DestroyTexture(t);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "misc.h"
+
+// Counts heap allocations and texture churn so a replay can check that
+// steady frames allocate nothing. On glibc malloc itself is interposed and on
+// macOS the default malloc zone is wrapped, which covers SDL too; elsewhere
+// only SDL's allocator is hooked.
+
+typedef struct
+{
+  unsigned long long allocs;
+  unsigned long long frees;
+  unsigned long long textures_created;
+  unsigned long long textures_destroyed;
+} AllocCounts;
+
+void init_alloc_tracking(void);
+
+void get_alloc_counts(AllocCounts *out);
+
+void track_texture_create(void);
+
+void destroy_texture(SDL_Texture *t);
@@ -0,0 +1,324 @@
+#include "assert.h"
+#include "stdio.h"
+#include "unistd.h"
+
+#include "collection.h"
+#include "transform.h"
+
+#define MAX_BLOCK_BYTES (1 + COLLECTION_BLOCK_SZ * 129)
+
+typedef struct
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned long long cnt;
+  unsigned int block_sz;
+  unsigned int block_cnt;
+  unsigned long long index_offset;
+  unsigned int rows;
+  unsigned int cols;
+  unsigned int mapping;
+  unsigned int reserved; // 0
+} CollectionHeader;
+
+static int popcount(uint128_t b)
+{
+  return __builtin_popcountll(b.high) + __builtin_popcountll(b.low);
+}
+
+static uint128_t xor_boards(uint128_t a, uint128_t b)
+{
+  return (uint128_t){a.high ^ b.high, a.low ^ b.low};
+}
+
+// bit i < 64 is bit i of low, the rest are in high
+static unsigned char *put_sparse(unsigned char *p, uint128_t b)
+{
+  unsigned char *cnt = p++;
+  for (unsigned long long w = b.low; w; w &= w - 1)
+    *p++ = __builtin_ctzll(w);
+  for (unsigned long long w = b.high; w; w &= w - 1)
+    *p++ = 64 + __builtin_ctzll(w);
+  *cnt = p - cnt - 1;
+  return p;
+}
+
+// the caller checks the list fits, indices past 127 are left in *bad
+static const unsigned char *get_sparse(const unsigned char *p, uint128_t *b, unsigned char *bad)
+{
+  int cnt = *p++;
+  b->high = b->low = 0;
+  for (int k = 0; k < cnt; ++k, ++p)
+  {
+    // branch free: pick the word by the top bit of the index
+    unsigned long long bit = 1ULL << (*p & 63), hi = -(unsigned long long)((*p >> 6) & 1);
+    b->high |= bit & hi;
+    b->low |= bit & ~hi;
+    *bad |= *p;
+  }
+  return p;
+}
+
+// a count byte and that many indices before end
+static int sparse_fits(const unsigned char *p, const unsigned char *end)
+{
+  return p < end && *p < end - p;
+}
+
+static size_t encode_block(const uint128_t *boards, int n, unsigned char *buf)
+{
+  size_t raw = 16 * n, sparse = 0, delta = 0;
+  uint128_t prev = {0, 0};
+  for (int i = 0; i < n; ++i)
+  {
+    sparse += 1 + popcount(boards[i]);
+    delta += 1 + popcount(xor_boards(boards[i], prev));
+    prev = boards[i];
+  }
+
+  unsigned char *p = buf + 1;
+  prev = (uint128_t){0, 0};
+  if (raw <= sparse && raw <= delta)
+  {
+    buf[0] = ENC_RAW;
+    for (int i = 0; i < n; ++i, p += 16)
+    {
+      memcpy(p, &boards[i].high, 8);
+      memcpy(p + 8, &boards[i].low, 8);
+    }
+  }
+  else if (sparse <= delta)
+  {
+    buf[0] = ENC_SPARSE;
+    for (int i = 0; i < n; ++i)
+      p = put_sparse(p, boards[i]);
+  }
+  else
+  {
+    buf[0] = ENC_DELTA;
+    for (int i = 0; i < n; ++i)
+    {
+      p = put_sparse(p, xor_boards(boards[i], prev));
+      prev = boards[i];
+    }
+  }
+  return p - buf;
+}
+
+// len bytes of block, -1 if they are not exactly n boards
+static int decode_block(const unsigned char *buf, size_t len, int n, uint128_t *boards)
+{
+  const unsigned char *p = buf + 1, *end = buf + len;
+  unsigned char bad = 0;
+  uint128_t prev = {0, 0};
+  switch (buf[0])
+  {
+  case ENC_RAW:
+    if (len != 1 + 16 * (size_t)n)
+      return -1;
+    for (int i = 0; i < n; ++i, p += 16)
+    {
+      memcpy(&boards[i].high, p, 8);
+      memcpy(&boards[i].low, p + 8, 8);
+    }
+    return 0;
+  case ENC_SPARSE:
+    for (int i = 0; i < n; ++i)
+    {
+      if (!sparse_fits(p, end))
+        return -1;
+      p = get_sparse(p, &boards[i], &bad);
+    }
+    return p == end && !(bad & 0x80) ? 0 : -1;
+  case ENC_DELTA:
+    for (int i = 0; i < n; ++i)
+    {
+      if (!sparse_fits(p, end))
+        return -1;
+      p = get_sparse(p, &boards[i], &bad);
+      boards[i] = prev = xor_boards(boards[i], prev);
+    }
+    return p == end && !(bad & 0x80) ? 0 : -1;
+  }
+  return -1;
+}
+
+int save_collection(const char *path, const uint128_t *boards, size_t n, int rows, int cols,
+                    SquareMapping mapping)
+{
+  FILE *fp = fopen(path, "wb");
+  if (!fp)
+    return -1;
+
+  CollectionHeader h = {COLLECTION_MAGIC, COLLECTION_VERSION, n, COLLECTION_BLOCK_SZ,
+                        (n + COLLECTION_BLOCK_SZ - 1) / COLLECTION_BLOCK_SZ, 0, rows, cols, mapping, 0};
+  unsigned long long *offsets = malloc((h.block_cnt + 1) * sizeof(unsigned long long));
+  unsigned char *buf = malloc(MAX_BLOCK_BYTES);
+  assert(offsets && buf);
+
+  fwrite(&h, sizeof(h), 1, fp);
+  offsets[0] = sizeof(h);
+  for (unsigned int b = 0; b < h.block_cnt; ++b)
+  {
+    size_t first = (size_t)b * COLLECTION_BLOCK_SZ;
+    int cnt = n - first < COLLECTION_BLOCK_SZ ? n - first : COLLECTION_BLOCK_SZ;
+    size_t len = encode_block(boards + first, cnt, buf);
+    fwrite(buf, 1, len, fp);
+    offsets[b + 1] = offsets[b] + len;
+  }
+
+  h.index_offset = offsets[h.block_cnt];
+  fwrite(offsets, sizeof(unsigned long long), h.block_cnt + 1, fp);
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&h, sizeof(h), 1, fp);
+
+  free(buf);
+  free(offsets);
+  return fclose(fp) ? -1 : 0;
+}
+
+Collection *open_collection(const char *path)
+{
+  CollectionHeader h;
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return NULL;
+  if (!fread(&h, sizeof(h), 1, fp) || h.magic != COLLECTION_MAGIC ||
+      h.version != COLLECTION_VERSION || h.block_sz != COLLECTION_BLOCK_SZ)
+  {
+    fclose(fp);
+    return NULL;
+  }
+
+  // the index has to fit in the file before it is allocated
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  unsigned long long index_sz = ((unsigned long long)h.block_cnt + 1) * sizeof(unsigned long long);
+  if (h.block_cnt != h.cnt / COLLECTION_BLOCK_SZ + (h.cnt % COLLECTION_BLOCK_SZ != 0) ||
+      h.mapping >= MAPPING_CNT || h.rows < 1 || h.cols < 1 || h.rows * h.cols > 128 ||
+      size < 0 || h.index_offset > (unsigned long long)size ||
+      index_sz > (unsigned long long)size - h.index_offset)
+  {
+    fclose(fp);
+    return NULL;
+  }
+
+  Collection *c = malloc(sizeof(Collection));
+  c->fp = fp;
+  c->cnt = h.cnt;
+  c->block_cnt = h.block_cnt;
+  c->rows = h.rows;
+  c->cols = h.cols;
+  c->mapping = h.mapping;
+  c->cached_block = -1;
+  c->offsets = malloc(index_sz);
+  assert(c->offsets);
+  fseek(fp, h.index_offset, SEEK_SET);
+  int ok = fread(c->offsets, sizeof(unsigned long long), h.block_cnt + 1, fp) == h.block_cnt + 1 &&
+           c->offsets[0] == sizeof(h) && c->offsets[h.block_cnt] == h.index_offset;
+  // blocks are back to back, none empty and none bigger than a raw block
+  for (unsigned int b = 0; ok && b < h.block_cnt; ++b)
+    ok = c->offsets[b + 1] > c->offsets[b] && c->offsets[b + 1] - c->offsets[b] <= MAX_BLOCK_BYTES;
+  if (!ok)
+  {
+    close_collection(c);
+    return NULL;
+  }
+  return c;
+}
+
+static int block_boards(const Collection *c, unsigned int b)
+{
+  size_t first = (size_t)b * COLLECTION_BLOCK_SZ;
+  return c->cnt - first < COLLECTION_BLOCK_SZ ? c->cnt - first : COLLECTION_BLOCK_SZ;
+}
+
+static int load_block(Collection *c, unsigned int b, unsigned char *buf, uint128_t *out)
+{
+  size_t len = c->offsets[b + 1] - c->offsets[b];
+  fseek(c->fp, c->offsets[b], SEEK_SET);
+  if (fread(buf, 1, len, c->fp) != len)
+    return -1;
+  return decode_block(buf, len, block_boards(c, b), out);
+}
+
+int collection_get(Collection *c, size_t i, uint128_t *b)
+{
+  if (i >= c->cnt)
+    return -1;
+  int block = i / COLLECTION_BLOCK_SZ;
+  if (block != c->cached_block)
+  {
+    unsigned char buf[MAX_BLOCK_BYTES];
+    c->cached_block = -1;
+    if (load_block(c, block, buf, c->cache))
+      return -1;
+    c->cached_block = block;
+  }
+  *b = c->cache[i % COLLECTION_BLOCK_SZ];
+  return 0;
+}
+
+// reads every block in one go and decodes them back to back into c->cnt
+// boards, -1 on a read or decode error
+int collection_read_all(Collection *c, uint128_t *boards)
+{
+  size_t len = c->offsets[c->block_cnt] - c->offsets[0];
+  unsigned char *buf = malloc(len ? len : 1);
+  assert(buf);
+  fseek(c->fp, c->offsets[0], SEEK_SET);
+  int res = fread(buf, 1, len, c->fp) == len ? 0 : -1;
+  for (unsigned int b = 0; !res && b < c->block_cnt; ++b)
+    res = decode_block(buf + c->offsets[b] - c->offsets[0], c->offsets[b + 1] - c->offsets[b],
+                       block_boards(c, b), boards + (size_t)b * COLLECTION_BLOCK_SZ);
+  free(buf);
+  return res;
+}
+
+// rewrites the whole file, meant for the editor's one board at a time saves;
+// a file that is there but does not read back, or holds boards of another
+// grid size, is left alone. b is in mapping on a rows x cols grid and is
+// stored in the file's mapping
+int collection_append(const char *path, uint128_t b, int rows, int cols, SquareMapping mapping)
+{
+  size_t n = 0;
+  uint128_t *boards;
+  SquareMapping stored = mapping;
+  Collection *c = open_collection(path);
+  if (c)
+  {
+    boards = malloc((c->cnt + 1) * sizeof(uint128_t));
+    assert(boards);
+    n = c->cnt;
+    stored = c->mapping;
+    int res = c->rows != rows || c->cols != cols ? -1 : collection_read_all(c, boards);
+    close_collection(c);
+    if (res)
+    {
+      free(boards);
+      return -1;
+    }
+  }
+  else if (!access(path, F_OK))
+    return -1;
+  else
+    boards = malloc(sizeof(uint128_t));
+  assert(boards);
+  if (stored != mapping)
+  {
+    Macro *m = create_remap(rows, cols, mapping, stored);
+    b = macro_apply(m, b);
+    free(m);
+  }
+  boards[n++] = b;
+  int res = save_collection(path, boards, n, rows, cols, stored);
+  free(boards);
+  return res;
+}
+
+void close_collection(Collection *c)
+{
+  fclose(c->fp);
+  free(c->offsets);
+  free(c);
+}
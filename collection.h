@@ -0,0 +1,49 @@
+#pragma once
+
+#include "stdio.h"
+
+#include "misc.h"
+
+#define COLLECTION_MAGIC 0x4c434242 // "BBCL"
+#define COLLECTION_VERSION 3
+#define COLLECTION_BLOCK_SZ 256
+
+// file: header | blocks | index of block_cnt + 1 offsets
+// the header names the grid size and SquareMapping every board is stored in
+// each block is one encoding byte followed by its boards:
+//   ENC_RAW    16 bytes per board, high word first
+//   ENC_SPARSE per board a count byte then that many set bit indices
+//   ENC_DELTA  like sparse, but of the xor with the previous board
+typedef enum
+{
+  ENC_RAW,
+  ENC_SPARSE,
+  ENC_DELTA,
+} BlockEncoding;
+
+typedef struct
+{
+  FILE *fp;
+  unsigned long long cnt;
+  unsigned int block_cnt;
+  int rows;
+  int cols;
+  SquareMapping mapping;
+  unsigned long long *offsets;
+  // last decoded block, so walking board by board reads each block once
+  int cached_block;
+  uint128_t cache[COLLECTION_BLOCK_SZ];
+} Collection;
+
+int save_collection(const char *path, const uint128_t *boards, size_t n, int rows, int cols,
+                    SquareMapping mapping);
+
+Collection *open_collection(const char *path);
+
+int collection_get(Collection *c, size_t i, uint128_t *b);
+
+int collection_read_all(Collection *c, uint128_t *boards);
+
+int collection_append(const char *path, uint128_t b, int rows, int cols, SquareMapping mapping);
+
+void close_collection(Collection *c);
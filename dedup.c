@@ -0,0 +1,264 @@
+#include "assert.h"
+#include "stdio.h"
+
+#include "dedup.h"
+
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+#define CHUNK_SZ (1 << 20)
+#define SHARD_MIN_CAP (1 << 10)
+
+typedef struct
+{
+  int has_zero; // the all zero board doubles as the empty slot
+  size_t cnt;
+  size_t mask;
+  uint128_t *slots;
+} Shard;
+
+typedef struct
+{
+  const Symmetries *sy;
+  Shard *shards;
+  uint128_t *boards;
+  uint128_t *canon;
+  unsigned long long *hashes;
+  unsigned char *keep;
+  size_t n;
+  int id;
+  int threads;
+} DedupJob;
+
+unsigned long long hash_board(uint128_t b)
+{
+  unsigned long long h = b.low ^ (b.high * 0x9e3779b97f4a7c15ULL);
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+static Macro *symmetry(int rows, int cols, SquareMapping mapping, int step_cnt,
+                       BlockType a, BlockType b)
+{
+  Macro *m = malloc(sizeof(Macro));
+  assert(m);
+  snprintf(m->name, MACRO_NAME_SZ, "sym");
+  m->rows = rows;
+  m->cols = cols;
+  m->from = m->to = mapping;
+  m->step_cnt = step_cnt;
+  m->steps[0] = a;
+  m->steps[1] = b;
+  macro_compile(m);
+  return m;
+}
+
+Symmetries *create_symmetries(int rows, int cols, SquareMapping mapping)
+{
+  Symmetries *sy = malloc(sizeof(Symmetries));
+  sy->rows = rows;
+  sy->cols = cols;
+  sy->sym_cnt = 0;
+  sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 0, FLIP, FLIP);
+  sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 1, FLIP, FLIP);
+  sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 1, MIRROR, MIRROR);
+  sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 2, FLIP, MIRROR);
+  if (rows == cols)
+  {
+    sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 1, ROT_LEFT, ROT_LEFT);
+    sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 1, ROT_RIGHT, ROT_RIGHT);
+    sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 2, FLIP, ROT_LEFT);
+    sy->syms[sy->sym_cnt++] = symmetry(rows, cols, mapping, 2, FLIP, ROT_RIGHT);
+  }
+  return sy;
+}
+
+static int board_less(uint128_t a, uint128_t b)
+{
+  return a.high < b.high || (a.high == b.high && a.low < b.low);
+}
+
+// smallest of the board's images, as a 128-bit number
+uint128_t canonical_form(const Symmetries *sy, uint128_t b, unsigned long long *hash)
+{
+  uint128_t best = b;
+  for (int i = 1; i < sy->sym_cnt; ++i)
+  {
+    uint128_t t = macro_apply(sy->syms[i], b);
+    if (board_less(t, best))
+      best = t;
+  }
+  if (hash)
+    *hash = hash_board(best);
+  return best;
+}
+
+void delete_symmetries(Symmetries *sy)
+{
+  for (int i = 0; i < sy->sym_cnt; ++i)
+    free(sy->syms[i]);
+  free(sy);
+}
+
+// doubles the table, so memory follows the number of distinct boards
+// rather than the size of the input
+static void shard_grow(Shard *s)
+{
+  size_t mask = 2 * s->mask + 1;
+  uint128_t *slots = calloc(mask + 1, sizeof(uint128_t));
+  assert(slots);
+  for (size_t i = 0; i <= s->mask; ++i)
+  {
+    uint128_t b = s->slots[i];
+    if (!b.high && !b.low)
+      continue;
+    size_t j = hash_board(b) & mask;
+    while (slots[j].high || slots[j].low)
+      j = (j + 1) & mask;
+    slots[j] = b;
+  }
+  free(s->slots);
+  s->slots = slots;
+  s->mask = mask;
+}
+
+// returns 1 if b was not in the shard yet
+static int shard_insert(Shard *s, uint128_t b, unsigned long long hash)
+{
+  if (!b.high && !b.low)
+  {
+    int added = !s->has_zero;
+    s->has_zero = 1;
+    return added;
+  }
+  for (size_t i = hash & s->mask;; i = (i + 1) & s->mask)
+  {
+    uint128_t *slot = &s->slots[i];
+    if (!slot->high && !slot->low)
+    {
+      *slot = b;
+      // keep the table at most half full
+      if (++s->cnt * 2 > s->mask + 1)
+        shard_grow(s);
+      return 1;
+    }
+    if (slot->high == b.high && slot->low == b.low)
+      return 0;
+  }
+}
+
+static int canon_worker(void *data)
+{
+  DedupJob *job = data;
+  size_t per = (job->n + job->threads - 1) / job->threads;
+  size_t lo = job->id * per, hi = lo + per > job->n ? job->n : lo + per;
+  for (size_t i = lo; i < hi; ++i)
+    job->canon[i] = canonical_form(job->sy, job->boards[i], &job->hashes[i]);
+  return 0;
+}
+
+// every thread walks the whole chunk in order but only touches its shards,
+// so no locks and the first board of a class always wins
+static int insert_worker(void *data)
+{
+  DedupJob *job = data;
+  for (size_t i = 0; i < job->n; ++i)
+  {
+    int shard = job->hashes[i] >> (64 - SHARD_BITS);
+    if (shard % job->threads == job->id)
+      job->keep[i] = shard_insert(&job->shards[shard], job->canon[i], job->hashes[i]);
+  }
+  return 0;
+}
+
+static void run_workers(SDL_ThreadFunction fn, DedupJob *jobs, int threads)
+{
+  SDL_Thread *th[SHARDS];
+  for (int t = 1; t < threads; ++t)
+    th[t] = SDL_CreateThread(fn, "dedup", &jobs[t]);
+  fn(&jobs[0]);
+  for (int t = 1; t < threads; ++t)
+    SDL_WaitThread(th[t], NULL);
+}
+
+// *bad is set on a read error or a trailing partial board
+static size_t read_boards(FILE *fp, uint128_t *boards, size_t max, int *bad)
+{
+  size_t n = 0, got = 0;
+  unsigned long long w[2];
+  while (n < max && (got = fread(w, 1, sizeof(w), fp)) == sizeof(w))
+    boards[n++] = (uint128_t){w[0], w[1]};
+  *bad = (n < max && got) || ferror(fp);
+  return n;
+}
+
+long long dedup_file(const char *in, const char *out, int rows, int cols,
+                     SquareMapping mapping, int threads)
+{
+  FILE *fin = fopen(in, "rb");
+  if (!fin)
+    return -1;
+  FILE *fout = fopen(out, "wb");
+  if (!fout)
+  {
+    fclose(fin);
+    return -1;
+  }
+
+  threads = threads < 1 ? 1 : threads > SHARDS ? SHARDS : threads;
+  Symmetries *sy = create_symmetries(rows, cols, mapping);
+  Shard *shards = malloc(SHARDS * sizeof(Shard));
+  for (int i = 0; i < SHARDS; ++i)
+  {
+    shards[i].has_zero = 0;
+    shards[i].cnt = 0;
+    shards[i].mask = SHARD_MIN_CAP - 1;
+    shards[i].slots = calloc(SHARD_MIN_CAP, sizeof(uint128_t));
+    assert(shards[i].slots);
+  }
+
+  uint128_t *boards = malloc(CHUNK_SZ * sizeof(uint128_t));
+  uint128_t *canon = malloc(CHUNK_SZ * sizeof(uint128_t));
+  unsigned long long *hashes = malloc(CHUNK_SZ * sizeof(unsigned long long));
+  unsigned char *keep = malloc(CHUNK_SZ);
+  DedupJob jobs[SHARDS];
+  for (int t = 0; t < threads; ++t)
+    jobs[t] = (DedupJob){sy, shards, boards, canon, hashes, keep, 0, t, threads};
+
+  long long kept = 0;
+  size_t n;
+  int bad = 0;
+  while ((n = read_boards(fin, boards, CHUNK_SZ, &bad)) && !bad)
+  {
+    memset(keep, 0, n);
+    for (int t = 0; t < threads; ++t)
+      jobs[t].n = n;
+    run_workers(canon_worker, jobs, threads);
+    run_workers(insert_worker, jobs, threads);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (!keep[i])
+        continue;
+      unsigned long long w[2] = {boards[i].high, boards[i].low};
+      fwrite(w, sizeof(w), 1, fout);
+      kept++;
+    }
+  }
+
+  free(keep);
+  free(hashes);
+  free(canon);
+  free(boards);
+  for (int i = 0; i < SHARDS; ++i)
+    free(shards[i].slots);
+  free(shards);
+  delete_symmetries(sy);
+  fclose(fin);
+  if (fclose(fout) || bad)
+    return -1;
+  return kept;
+}
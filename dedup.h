@@ -0,0 +1,30 @@
+#pragma once
+
+#include "transform.h"
+
+#define MAX_SYMMETRIES 8
+
+// square grids have all 8 dihedral symmetries, the others only the 4 that
+// keep their shape (rotations are a no-op there, see transform_map)
+typedef struct
+{
+  int rows;
+  int cols;
+  int sym_cnt;
+  Macro *syms[MAX_SYMMETRIES];
+} Symmetries;
+
+unsigned long long hash_board(uint128_t b);
+
+Symmetries *create_symmetries(int rows, int cols, SquareMapping mapping);
+
+uint128_t canonical_form(const Symmetries *sy, uint128_t b, unsigned long long *hash);
+
+void delete_symmetries(Symmetries *sy);
+
+// streams a raw dump (16 bytes per board, high word first) from in to out,
+// keeping the first board of every symmetry class, returns boards kept or -1
+// (also on a read error or a trailing partial board);
+// in is only read front to back, so it can be a pipe
+long long dedup_file(const char *in, const char *out, int rows, int cols,
+                     SquareMapping mapping, int threads);
@@ -4,11 +4,19 @@
 #include "SDL2/SDL_render.h"
 #include "assert.h"
 #include "stdint.h"
+#include "math.h"
 #include "stdio.h"
 
 #include "SDL2/SDL_ttf.h"
 
+#include "alloc_track.h"
+#include "collection.h"
+#include "dedup.h"
 #include "misc.h"
+#include "replay.h"
+#include "stroke.h"
+#include "transform.h"
+#include "workspace.h"
 
 #define ALL 4
 #define WINDOW_WIDTH 1280
@@ -17,6 +25,14 @@
 
 #define MIN(x, y) ((x) > (y)) ? (y) : (x)
 
+#define ZOOM_STEP 1.25
+#define MIN_ZOOM 0.02
+#define MAX_ZOOM 32.0
+#define COLLECTION_PATH "boards.bbc"
+#define MACRO_PATH "macros.txt"
+#define APPLY_CHUNK (1 << 16) // boards per read in --convert and --apply-macro
+#define LOD_PITCH 3.0 // below this many px per cell, shade blocks of cells
+
 int coords_in_rect(SDL_Rect *r, int x, int y)
 {
   return r->x <= x && x <= r->x + r->w && r->y <= y && y <= r->y + r->h;
@@ -50,10 +66,16 @@ void render_block(SDL_Renderer *r, TTF_Font *f, ItemManager *im, Block *b)
   {
     BitGrid *bg = find_item(im, GRID, 0);
     assert(bg);
+    // only rerender the text when the number changes
+    static char shown[131];
     const char *c = grid_state(bg, b->extra_info);
-    SDL_DestroyTexture(b->texture);
-    b->texture = create_text_texture(r, f, c);
-    SDL_QueryTexture(b->texture, NULL, NULL, &b->r.w, &b->r.h);
+    if (!b->texture || strcmp(c, shown))
+    {
+      strcpy(shown, c);
+      destroy_texture(b->texture);
+      b->texture = create_text_texture(r, f, c);
+      SDL_QueryTexture(b->texture, NULL, NULL, &b->r.w, &b->r.h);
+    }
   }
 
   SDL_SetRenderDrawColor(r, b->color.r, b->color.g, b->color.b, b->color.a);
@@ -75,11 +97,8 @@ void render_block(SDL_Renderer *r, TTF_Font *f, ItemManager *im, Block *b)
   }
 }
 
-void render_dropdown(SDL_Renderer *r, ItemManager *im, DropdownMenu *dm, int *row, int *col)
+void render_dropdown(SDL_Renderer *r, ItemManager *im, DropdownMenu *dm)
 {
-  *row = dm->selected == _128BIT ? 8 : pow(2, dm->selected);
-  *col = dm->selected == _128BIT ? 16 : 8;
-
   dm->menu.texture = dm->items[dm->selected].texture;
   render_block(r, NULL, im, &dm->menu);
   if (dm->is_open)
@@ -89,57 +108,158 @@ void render_dropdown(SDL_Renderer *r, ItemManager *im, DropdownMenu *dm, int *ro
   }
 }
 
-void render_grid(SDL_Renderer *r, TTF_Font *f, ItemManager *im, BitGrid *bg, int rows, int cols)
+// places cell 0 and sizes cells from the window fit, zoom and pan
+void update_grid_view(BitGrid *bg)
+{
+  Viewport *v = &bg->view;
+  double fit_w = (double)(WINDOW_WIDTH - bg->dim.x) / bg->cols,
+         fit_h = (double)(WINDOW_HEIGHT - bg->dim.y) / bg->rows;
+
+  v->area = (SDL_Rect){bg->dim.x, bg->dim.y, WINDOW_WIDTH - bg->dim.x, WINDOW_HEIGHT - bg->dim.y};
+  v->pitch = (fit_w < fit_h ? fit_w : fit_h) * v->zoom;
+  v->ox = bg->dim.x + ((WINDOW_WIDTH - bg->dim.x) - (int)(v->pitch * bg->cols)) / 2 + v->pan_x;
+  v->oy = bg->dim.y + ((WINDOW_HEIGHT - bg->dim.y) - (int)(v->pitch * bg->rows)) / 2 + v->pan_y;
+}
+
+// pitch must never be 0 between a reset and the next render_grid, clicks
+// and strokes later in the frame divide by it
+void reset_grid_view(BitGrid *bg)
+{
+  bg->view = (Viewport){1, 0, 0, 0, 0, 0};
+  update_grid_view(bg);
+}
+
+// first and one past last cell index along an axis inside [lo, hi)
+void visible_range(double origin, double pitch, int n, int lo, int hi, int *first, int *last)
+{
+  *first = (int)floor((lo - origin) / pitch);
+  *last = (int)ceil((hi - origin) / pitch);
+  *first = *first < 0 ? 0 : *first;
+  *last = *last > n ? n : *last;
+}
+
+int grid_cell_at(BitGrid *bg, int x, int y)
+{
+  SDL_Rect *a = &bg->view.area;
+  if (x < a->x || x >= a->x + a->w || y < a->y || y >= a->y + a->h)
+    return -1;
+  int col = (int)floor((x - bg->view.ox) / bg->view.pitch),
+      row = (int)floor((y - bg->view.oy) / bg->view.pitch);
+  if (row < 0 || row >= bg->rows || col < 0 || col >= bg->cols)
+    return -1;
+  return row * bg->cols + col;
+}
+
+void zoom_grid(BitGrid *bg, int mx, int my, int steps)
 {
-  rows = rows >= 1 ? rows : 1;
-  cols = cols >= 1 ? cols : 1;
+  Viewport *v = &bg->view;
+  double zoom = v->zoom * pow(ZOOM_STEP, steps);
+  zoom = zoom < MIN_ZOOM ? MIN_ZOOM : zoom > MAX_ZOOM ? MAX_ZOOM : zoom;
+
+  // keep the point under the cursor still
+  double u = (mx - v->ox) / v->pitch, w = (my - v->oy) / v->pitch;
+  v->zoom = zoom;
+  v->pan_x = v->pan_y = 0;
+  update_grid_view(bg);
+  v->pan_x = mx - (int)(u * v->pitch) - v->ox;
+  v->pan_y = my - (int)(w * v->pitch) - v->oy;
+  update_grid_view(bg);
+}
 
-  if (rows != bg->rows || cols != bg->cols)
+// aggregates k x k cells into one shaded square, shade is their popcount
+void render_grid_lod(SDL_Renderer *r, BitGrid *bg, int r0, int r1, int c0, int c1)
+{
+  Viewport *v = &bg->view;
+  int k = (int)ceil(LOD_PITCH / v->pitch);
+  r0 -= r0 % k;
+  c0 -= c0 % k;
+  for (int row = r0; row < r1; row += k)
   {
-    free(bg->grid);
-    bg->grid = malloc(rows * cols * sizeof(Block));
-    bg->state.high = bg->state.low = 0;
-    for (int i = 0; i < rows * cols; ++i)
+    int kr = row + k > bg->rows ? bg->rows - row : k;
+    for (int col = c0; col < c1; col += k)
     {
-      bg->grid[i].is_hovered = 0;
-      bg->grid[i].texture = NULL;
-      bg->grid[i].color = (SDL_Color){0xff, 0xff, 0xff, 0xff};
+      int kc = col + k > bg->cols ? bg->cols - col : k;
+      int cnt = 0;
+      for (int i = 0; i < kr; ++i)
+        cnt += count_cells(bg, row + i, col, kc);
+
+      int shade = 0x30 + (0xff - 0x30) * cnt / (kr * kc);
+      SDL_Rect b = {v->ox + (int)(col * v->pitch), v->oy + (int)(row * v->pitch),
+                    (int)ceil(kc * v->pitch), (int)ceil(kr * v->pitch)};
+      SDL_SetRenderDrawColor(r, shade, shade, shade, 0xff);
+      SDL_RenderFillRect(r, &b);
     }
-    bg->rows = rows;
-    bg->cols = cols;
   }
+}
 
-  int padding = 1;
-
-  bg->dim.w = (WINDOW_WIDTH - bg->dim.x) / bg->cols - padding;
-  bg->dim.h = (WINDOW_HEIGHT - bg->dim.y) / bg->rows - padding;
+void resize_grid(BitGrid *bg, int rows, int cols)
+{
+  if (rows == bg->rows && cols == bg->cols)
+    return;
 
-  bg->dim.w = MIN(bg->dim.w, bg->dim.h);
+  // reuse the cell pool, only grow it past what add_grid reserved
+  for (int i = 0; i < bg->rows * bg->cols; ++i)
+    destroy_texture(bg->grid[i].texture);
+  if (rows * cols > bg->cap)
+  {
+    free(bg->grid);
+    bg->cap = rows * cols;
+    bg->grid = malloc(bg->cap * sizeof(Block));
+  }
+  bg->state.high = bg->state.low = 0;
+  for (int i = 0; i < rows * cols; ++i)
+  {
+    bg->grid[i].is_hovered = 0;
+    bg->grid[i].texture = NULL;
+    bg->grid[i].color = (SDL_Color){0xff, 0xff, 0xff, 0xff};
+  }
+  bg->rows = rows;
+  bg->cols = cols;
+  reset_grid_view(bg);
+}
 
-  if (bg->dim.w <= 0)
-    assert(0);
+// the grid is sized by select_grid_size before rendering, never here
+void render_grid(SDL_Renderer *r, TTF_Font *f, ItemManager *im, BitGrid *bg)
+{
+  int padding = 1;
+  update_grid_view(bg);
+  Viewport *v = &bg->view;
 
-  bg->dim.h = bg->dim.w;
+  // only walk cells that intersect the grid area
+  SDL_Rect area = v->area;
+  int r0, r1, c0, c1;
+  visible_range(v->oy, v->pitch, bg->rows, area.y, area.y + area.h, &r0, &r1);
+  visible_range(v->ox, v->pitch, bg->cols, area.x, area.x + area.w, &c0, &c1);
 
-  int gx = bg->dim.x + ((WINDOW_WIDTH - bg->dim.x) - (bg->dim.w + padding) * bg->cols) / 2,
-      gy = bg->dim.y + ((WINDOW_HEIGHT - bg->dim.y) - (bg->dim.h + padding) * bg->rows) / 2;
+  SDL_RenderSetClipRect(r, &area);
+  if (v->pitch < LOD_PITCH)
+  {
+    render_grid_lod(r, bg, r0, r1, c0, c1);
+    SDL_RenderSetClipRect(r, NULL);
+    return;
+  }
 
-  for (int i = 0; i < bg->rows * bg->cols; ++i)
+  bg->dim.w = bg->dim.h = (int)v->pitch - padding;
+  for (int row = r0; row < r1; ++row)
   {
-    int row = i / bg->cols, col = i % bg->cols;
-    SDL_Rect *gdim = &bg->grid[i].r;
-    gdim->x = gx + (bg->dim.w + padding) * col;
-    gdim->y = gy + (bg->dim.h + padding) * row;
-    gdim->w = bg->dim.w;
-    gdim->h = bg->dim.h;
-
-    SDL_Color *color = &bg->grid[i].color;
-    SDL_SetRenderDrawColor(r, color->r, color->g, color->b, color->a);
-    if (bg->grid[i].is_hovered)
-      SDL_RenderFillRect(r, gdim);
-    else
-      SDL_RenderDrawRect(r, gdim);
+    for (int col = c0; col < c1; ++col)
+    {
+      int i = row * bg->cols + col;
+      SDL_Rect *gdim = &bg->grid[i].r;
+      gdim->x = v->ox + (int)(v->pitch * col);
+      gdim->y = v->oy + (int)(v->pitch * row);
+      gdim->w = bg->dim.w;
+      gdim->h = bg->dim.h;
+
+      SDL_Color *color = &bg->grid[i].color;
+      SDL_SetRenderDrawColor(r, color->r, color->g, color->b, color->a);
+      if (bg->grid[i].is_hovered)
+        SDL_RenderFillRect(r, gdim);
+      else
+        SDL_RenderDrawRect(r, gdim);
+    }
   }
+  SDL_RenderSetClipRect(r, NULL);
 }
 
 SDL_Color rc() { return (SDL_Color){rand() % 256, rand() % 256, rand() % 256, 0xff}; }
@@ -179,7 +299,7 @@ void init_ui_layout(SDL_Renderer *r, TTF_Font *f, ItemManager *im)
 
   int half_w = (w - padding) / 2;
   add_block(r, f, im, ROT_LEFT, x, y, half_w, h, rc(), "RL");
-  add_block(r, f, im, ROT_LEFT, x + half_w + padding, y, half_w, h, rc(), "RR");
+  add_block(r, f, im, ROT_RIGHT, x + half_w + padding, y, half_w, h, rc(), "RR");
   y += h + padding;
 
   half_w = (w - padding * 2) / 3;
@@ -202,31 +322,23 @@ void init_ui_layout(SDL_Renderer *r, TTF_Font *f, ItemManager *im)
     add_block(r, f, im, itypes[cnt], x + i * (half_w + padding), y, half_w, h, rc(), ttypes[cnt]);
   y += h + padding;
 
-  add_block(r, f, im, FLIP, x, y, w, h, rc(), "Flip");
+  half_w = (w - padding) / 2;
+  add_block(r, f, im, FLIP, x, y, half_w, h, rc(), "Flip");
+  add_block(r, f, im, MIRROR, x + half_w + padding, y, half_w, h, rc(), "Mir");
   y += h + padding;
 
   add_block(r, f, im, CLEAR, x, y, w, h, rc(), "Clear");
-}
+  y += h + padding;
 
-// fix, bad
-void handle_grid_fill(BitGrid *bg, int j)
-{
-  if (bg->cols == 16)
-  {
-    if (j <= 63)
-      bg->state.high ^= 1ULL << (63 - j);
-    else
-      bg->state.low ^= 1ULL << (127 - j);
-  }
-  else
-    bg->state.low ^= 1ULL << (bg->rows * bg->cols - 1 - j);
+  add_block(r, f, im, REC_MACRO, x, y, half_w, h, rc(), "Rec");
+  add_block(r, f, im, PLAY_MACRO, x + half_w + padding, y, half_w, h, rc(), "Play");
 }
 
-void handle_mousemotion(ItemManager *im, int mx, int my, int pmx, int pmy, int mouse_down)
+// hover only, painting goes through the frame's Stroke
+void handle_mousemotion(ItemManager *im, int mx, int my)
 {
   Block *b;
   DropdownMenu *dm;
-  BitGrid *bg;
   for (int i = 0; i < im->cur_sz; ++i)
   {
     switch (im->items[i].type)
@@ -255,66 +367,59 @@ void handle_mousemotion(ItemManager *im, int mx, int my, int pmx, int pmy, int m
       }
       break;
     case GRID:
-      bg = (BitGrid*)im->items[i].item;
-      for (int j = 0; j < bg->rows * bg->cols; ++j)
-      {
-        if (coords_in_rect(&bg->grid[j].r, mx, my) && mouse_down && 
-            !coords_in_rect(&bg->grid[j].r, pmx, pmy))
-        {
-          bg->grid[j].is_hovered ^= 1;
-
-          handle_grid_fill(bg, j);
-        }
-      }
       break;
     }
   }
 }
 
-void handle_block_click(ItemManager *im, Block *b, int x, int y)
+void handle_block_click(ItemManager *im, MacroManager *mm, Block *b, int x, int y)
 {
   Block *block;
+  Macro *m;
   BitGrid *bg = find_item(im, GRID, 0);
   if (coords_in_rect(&b->r, x, y))
   {
+    if (is_transform(b->type))
+    {
+      bg->state = apply_transform(b->type, bg);
+      sync_grid_cells(bg);
+      macro_record(mm, b->type, bg->rows, bg->cols);
+      return;
+    }
+
     switch (b->type) 
     {
     case COPY:
       block = find_item(im, BLOCK, NUM_DISPLAY);
       SDL_SetClipboardText(grid_state(bg, block ? block->extra_info : HEX));
       break;
-    case ROT_LEFT:
-      break;
-    case ROT_RIGHT:
-      break;
-    case MOVE_NORTH:
-      break;
-    case MOVE_NORTHEAST:
-      break;
-    case MOVE_EAST:
-      break;
-    case MOVE_SOUTHEAST:
-      break;
-    case MOVE_SOUTH:
-      break;
-    case MOVE_SOUTHWEST:
-      break;
-    case MOVE_WEST:
-      break;
-    case MOVE_NORTHWEST:
-      break;
-    case FLIP:
-      break;
-    case MIRROR:
-      break;
     case CLEAR:
       bg->state.high = bg->state.low = 0;
       for (int i = 0; i < bg->rows * bg->cols; ++i)
         bg->grid[i].is_hovered = 0;
       break;
+    case REC_MACRO:
+      if (mm->recording)
+        macro_end(mm);
+      else
+        macro_begin(mm, bg->rows, bg->cols, bg->mapping);
+      break;
+    case PLAY_MACRO:
+      // compiled for one grid size, replays only on that
+      m = macro_selected(mm);
+      if (!mm->recording && m && m->rows == bg->rows && m->cols == bg->cols)
+      {
+        // recorded steps move cells, so after m the table is rebuilt, not dropped
+        macro_set_mapping(m, bg->mapping);
+        bg->state = macro_apply(m, bg->state);
+        sync_grid_cells(bg);
+      }
+      break;
     case NUM_DISPLAY:
       b->extra_info = (b->extra_info + 1) % 3;
       break;
+    default:
+      break;
     }
   }
 }
@@ -342,20 +447,13 @@ void handle_dropdown_click(DropdownMenu *dm, int x, int y)
     dm->is_open = 0;
 }
 
-void handle_grid_click(BitGrid *bg, int x, int y)
+void handle_grid_click(BitGrid *bg, Stroke *st, int x, int y)
 {
-  for (int j = 0; j < bg->rows * bg->cols; ++j)
-  {
-    if (coords_in_rect(&bg->grid[j].r, x, y))
-    {
-      bg->grid[j].is_hovered ^= 1;
-
-      handle_grid_fill(bg, j);
-    }
-  }
+  if (grid_cell_at(bg, x, y) >= 0)
+    stroke_begin(st, bg, x, y);
 }
 
-void handle_mouseclick(ItemManager *im, int x, int y)
+void handle_mouseclick(ItemManager *im, MacroManager *mm, Stroke *st, int x, int y)
 {
   for (int i = 0; i < im->cur_sz; ++i)
   {
@@ -363,37 +461,375 @@ void handle_mouseclick(ItemManager *im, int x, int y)
     {
     case BLOCK:
       //if (no_rect_overlap(im, &((Block*)im->items[i].item)->r))
-        handle_block_click(im, im->items[i].item, x, y);
+        handle_block_click(im, mm, im->items[i].item, x, y);
       break;
     case DROPDOWN:
       handle_dropdown_click(im->items[i].item, x, y);
       break;
     case GRID:
-      handle_grid_click(im->items[i].item, x, y);
+      handle_grid_click(im->items[i].item, st, x, y);
       break;
     }
   }
 }
 
-int main()
+// -1 if name is not a mapping
+int parse_mapping(const char *name)
+{
+  for (int i = 0; i < MAPPING_CNT; ++i)
+    if (!strcmp(name, mapping_names[i]))
+      return i;
+  return -1;
+}
+
+int parse_grid_bits(const char *arg, int *rows, int *cols)
+{
+  int bits = atoi(arg);
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64 && bits != 128)
+    return -1;
+  *rows = bits == 128 ? 8 : bits / 8;
+  *cols = bits == 128 ? 16 : 8;
+  return 0;
+}
+
+int run_dedup(int argc, char **argv)
+{
+  int rows, cols, mapping = argc > 5 ? parse_mapping(argv[5]) : LERBEF;
+  if (parse_grid_bits(argc > 4 ? argv[4] : "64", &rows, &cols) || mapping < 0)
+  {
+    fprintf(stderr, "usage: %s --dedup in out [8|16|32|64|128] [mapping]\n", argv[0]);
+    return 1;
+  }
+  Uint64 start = SDL_GetPerformanceCounter();
+  long long kept = dedup_file(argv[2], argv[3], rows, cols, mapping, SDL_GetCPUCount());
+  if (kept < 0)
+  {
+    fprintf(stderr, "dedup: could not read %s (or it ends in a partial board) or write %s\n",
+            argv[2], argv[3]);
+    return 1;
+  }
+  printf("kept %lld boards in %.3fs\n", kept,
+         (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency());
+  return 0;
+}
+
+// runs m over every board of the raw dump in and writes them to out; in is
+// opened first so a bad input never touches out, and a read error or a
+// trailing partial board fails the run
+int map_raw_dump(const char *tool, const char *in, const char *out, const Macro *m)
+{
+  FILE *fin = fopen(in, "rb"), *fout;
+  if (!fin)
+    return perror(in), 1;
+  if (!(fout = fopen(out, "wb")))
+  {
+    perror(out);
+    fclose(fin);
+    return 1;
+  }
+
+  uint128_t *boards = malloc(APPLY_CHUNK * sizeof(uint128_t));
+  assert(boards);
+  unsigned long long w[2];
+  size_t n, got = 0, total = 0;
+  do
+  {
+    for (n = 0; n < APPLY_CHUNK && (got = fread(w, 1, sizeof(w), fin)) == sizeof(w); ++n)
+      boards[n] = (uint128_t){w[0], w[1]};
+    macro_apply_all(m, boards, n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      w[0] = boards[i].high;
+      w[1] = boards[i].low;
+      fwrite(w, sizeof(w), 1, fout);
+    }
+    total += n;
+  } while (n == APPLY_CHUNK);
+
+  int short_read = got || ferror(fin);
+  if (short_read)
+    fprintf(stderr, "%s: %s: short read after %zu boards\n", tool, in, total);
+  free(boards);
+  fclose(fin);
+  return fclose(fout) || short_read ? 1 : 0;
+}
+
+// rewrites a raw dump from one mapping to another with one fused permutation
+int run_convert(int argc, char **argv)
+{
+  int rows, cols, from = parse_mapping(argv[5]), to = parse_mapping(argv[6]);
+  if (parse_grid_bits(argv[4], &rows, &cols) || from < 0 || to < 0)
+  {
+    fprintf(stderr, "usage: %s --convert in out bits from to\n", argv[0]);
+    return 1;
+  }
+
+  Macro *m = create_remap(rows, cols, from, to);
+  int res = map_raw_dump("convert", argv[2], argv[3], m);
+  free(m);
+  return res;
+}
+
+// replays a saved macro on every board of a raw dump, optionally rebuilt for
+// another mapping
+int run_apply_macro(int argc, char **argv)
+{
+  MacroManager *mm = create_macro_manager(MACRO_PATH);
+  Macro *m = find_macro(mm, argv[2]);
+  int mapping = argc > 5 ? parse_mapping(argv[5]) : m ? (int)m->from : 0;
+  if (!m || mapping < 0)
+  {
+    fprintf(stderr, "usage: %s --apply-macro name in out [mapping] (name saved in %s)\n",
+            argv[0], MACRO_PATH);
+    delete_macro_manager(mm);
+    return 1;
+  }
+  macro_set_mapping(m, mapping);
+
+  int res = map_raw_dump("apply-macro", argv[3], argv[4], m);
+  delete_macro_manager(mm);
+  return res;
+}
+
+void update_title(SDL_Window *window, BitGrid *bg, Stroke *st, MacroManager *mm)
+{
+  char title[128], macro[48] = "no macro";
+  Macro *m = macro_selected(mm);
+  if (mm->recording)
+    snprintf(macro, sizeof(macro), "recording %s", mm->macros[mm->macro_cnt]->name);
+  else if (m)
+    snprintf(macro, sizeof(macro), "macro %s (%d/%d, %d steps)", m->name, mm->selected + 1,
+             mm->macro_cnt, m->step_cnt);
+  snprintf(title, sizeof(title), "Herm's Bitboard Editor - %s - %s - %s",
+           mapping_names[bg->mapping], paint_mode_names[st->mode], macro);
+  SDL_SetWindowTitle(window, title);
+}
+
+// keeps the drawn board and rewrites the state in the next mapping
+void cycle_mapping(BitGrid *bg, Workspace *ws)
+{
+  SquareMapping next = (bg->mapping + 1) % MAPPING_CNT;
+  workspace_remap(ws, bg->mapping, next);
+  Macro *m = create_remap(bg->rows, bg->cols, bg->mapping, next);
+  bg->state = macro_apply(m, bg->state);
+  bg->mapping = next;
+  free(m);
+}
+
+// switches the grid to a dropdown size, bringing back that size's board
+void select_grid_size(BitGrid *bg, Workspace *ws, int size)
+{
+  int rows, cols;
+  grid_dims(size, &rows, &cols);
+  if (rows == bg->rows && cols == bg->cols)
+    return;
+  resize_grid(bg, rows, cols);
+  bg->state = ws->snap->boards[size];
+  sync_grid_cells(bg);
+}
+
+void restore_history(BitGrid *bg, DropdownMenu *dm, Workspace *ws, const HistoryEntry *e)
+{
+  if (!e)
+    return;
+  dm->selected = e->size;
+  select_grid_size(bg, ws, e->size);
+  bg->state = e->state;
+  sync_grid_cells(bg);
+}
+
+// mirrors the editor into the mapped snapshot once a frame, a board that
+// changed since the last frame becomes one history entry (a whole drag is one)
+void sync_workspace(Workspace *ws, BitGrid *bg, DropdownMenu *dm, Block *num, Stroke *st)
+{
+  Snapshot *s = ws->snap;
+  const HistoryEntry *cur = history_current(ws);
+  if (!st->active && (cur->size != dm->selected || cur->state.high != bg->state.high ||
+      cur->state.low != bg->state.low))
+    history_push(ws, dm->selected, bg->state);
+
+  uint128_t *board = &s->boards[dm->selected];
+  if (board->high != bg->state.high || board->low != bg->state.low ||
+      s->selected != dm->selected || s->display != num->extra_info ||
+      s->mapping != (int)bg->mapping || s->paint_mode != (int)st->mode)
+  {
+    *board = bg->state;
+    s->selected = dm->selected;
+    s->display = num->extra_info;
+    s->mapping = bg->mapping;
+    s->paint_mode = st->mode;
+    ws->dirty = 1;
+  }
+  workspace_flush(ws);
+}
+
+// raw dump <-> collection, direction picked by pack; a pack records the dump's
+// grid size and mapping, an unpack writes the boards as they were packed
+int run_pack(int argc, char **argv, int pack)
+{
+  FILE *fp;
+  uint128_t *boards;
+  size_t n;
+  if (pack)
+  {
+    int rows, cols, mapping = argc > 5 ? parse_mapping(argv[5]) : LERBEF;
+    if (parse_grid_bits(argc > 4 ? argv[4] : "64", &rows, &cols) || mapping < 0)
+    {
+      fprintf(stderr, "usage: %s --pack raw out [8|16|32|64|128] [mapping]\n", argv[0]);
+      return 1;
+    }
+    if (!(fp = fopen(argv[2], "rb")))
+      return perror(argv[2]), 1;
+    size_t cap = 1024, got;
+    n = 0;
+    boards = malloc(cap * sizeof(uint128_t));
+    unsigned long long w[2];
+    while ((got = fread(w, 1, sizeof(w), fp)) == sizeof(w))
+    {
+      if (n == cap)
+      {
+        cap *= 2;
+        uint128_t *new_boards = realloc(boards, cap * sizeof(uint128_t));
+        assert(new_boards);
+        boards = new_boards;
+      }
+      boards[n++] = (uint128_t){w[0], w[1]};
+    }
+    // a read error or a trailing partial board, don't pack half a dump
+    int short_read = got || ferror(fp);
+    fclose(fp);
+    if (short_read)
+    {
+      fprintf(stderr, "%s: short read after %zu boards\n", argv[2], n);
+      free(boards);
+      return 1;
+    }
+    int res = save_collection(argv[3], boards, n, rows, cols, mapping);
+    free(boards);
+    return res ? perror(argv[3]), 1 : 0;
+  }
+
+  Collection *c = open_collection(argv[2]);
+  if (!c)
+  {
+    fprintf(stderr, "%s: not a collection\n", argv[2]);
+    return 1;
+  }
+  n = c->cnt;
+  boards = malloc(n * sizeof(uint128_t));
+  int res = collection_read_all(c, boards);
+  printf("%zu boards of %d bits in %s\n", n, c->rows * c->cols, mapping_names[c->mapping]);
+  close_collection(c);
+  if (res)
+  {
+    fprintf(stderr, "%s: damaged collection\n", argv[2]);
+    free(boards);
+    return 1;
+  }
+  if (!(fp = fopen(argv[3], "wb")))
+    return perror(argv[3]), 1;
+  for (size_t i = 0; i < n; ++i)
+  {
+    unsigned long long w[2] = {boards[i].high, boards[i].low};
+    fwrite(w, sizeof(w), 1, fp);
+  }
+  free(boards);
+  return fclose(fp) ? 1 : 0;
+}
+
+// s appends the board to the collection, [ and ] walk through it
+void handle_collection_key(BitGrid *bg, SDL_Keycode key, long long *pos)
+{
+  if (key == SDLK_s)
+  {
+    if (collection_append(COLLECTION_PATH, bg->state, bg->rows, bg->cols, bg->mapping))
+      fprintf(stderr, "%s: could not append the board (damaged, or of another grid size)\n",
+              COLLECTION_PATH);
+    return;
+  }
+
+  Collection *c = open_collection(COLLECTION_PATH);
+  if (!c)
+    return;
+  // the remap between mappings depends on the grid size, so only boards of
+  // this size are loaded
+  if (c->rows != bg->rows || c->cols != bg->cols)
+    fprintf(stderr, "%s holds %d-bit boards, switch the grid to that size\n", COLLECTION_PATH,
+            c->rows * c->cols);
+  else if (c->cnt)
+  {
+    *pos += key == SDLK_RIGHTBRACKET ? 1 : -1;
+    *pos = *pos < 0 ? c->cnt - 1 : *pos >= (long long)c->cnt ? 0 : *pos;
+    uint128_t b, mask = grid_mask(bg);
+    // bits with no cell behind them never reach the board
+    if (!collection_get(c, *pos, &b))
+    {
+      if (c->mapping != bg->mapping)
+      {
+        Macro *m = create_remap(bg->rows, bg->cols, c->mapping, bg->mapping);
+        b = macro_apply(m, b);
+        free(m);
+      }
+      bg->state = (uint128_t){b.high & mask.high, b.low & mask.low};
+      sync_grid_cells(bg);
+    }
+  }
+  close_collection(c);
+}
+
+int main(int argc, char **argv)
 {
   SDL_Window* window;
   SDL_Renderer* renderer;
   TTF_Font* font;
 
-  init(&window, &renderer, &font, WINDOW_WIDTH, WINDOW_HEIGHT);
+  if (argc >= 4 && !strcmp(argv[1], "--dedup"))
+    return run_dedup(argc, argv);
+  if (argc == 7 && !strcmp(argv[1], "--convert"))
+    return run_convert(argc, argv);
+  if (argc >= 5 && !strcmp(argv[1], "--apply-macro"))
+    return run_apply_macro(argc, argv);
+  if (argc >= 4 && argc <= 6 && !strcmp(argv[1], "--pack"))
+    return run_pack(argc, argv, 1);
+  if (argc == 4 && !strcmp(argv[1], "--unpack"))
+    return run_pack(argc, argv, 0);
+
+  init_alloc_tracking();
+  InputSession *session = open_input_session(argc, argv);
+  init(&window, &renderer, &font, WINDOW_WIDTH, WINDOW_HEIGHT,
+       session->mode == SESSION_REPLAY ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
 
   SDL_Color black = {0, 0, 0, 0xff};
   SDL_Color white = {0xff, 0xff, 0xff, 0xff};
   SDL_Event event;
 
-  int quit = 0, rows = 8, cols = 8, mouse_down = 0, prev_mx = 0, prev_my = 0;
+  int quit = 0, pan_down = 0, moved = 0, prev_mx = 0, prev_my = 0;
   ItemManager *im = create_item_manager(1);
+  // like the workspace, saved macros stay out of recordings and replays
+  MacroManager *mm = create_macro_manager(session->workspace ? MACRO_PATH : NULL);
   init_ui_layout(renderer, font, im);
+  BitGrid *bg = find_item(im, GRID, 0);
+  DropdownMenu *dm = find_item(im, DROPDOWN, 0);
+  Block *num = find_item(im, BLOCK, NUM_DISPLAY);
+  long long coll_pos = -1;
+  Stroke stroke = {0};
+
+  // pick up where the last session left off
+  Workspace *ws = open_workspace(session->workspace);
+  dm->selected = ws->snap->selected;
+  num->extra_info = ws->snap->display;
+  bg->mapping = ws->snap->mapping;
+  stroke.mode = ws->snap->paint_mode;
+  select_grid_size(bg, ws, dm->selected);
+  reset_grid_view(bg);
+  bg->state = ws->snap->boards[dm->selected];
+  sync_grid_cells(bg);
+  update_title(window, bg, &stroke, mm);
 
   while (!quit)
   {
-    while (SDL_PollEvent(&event))
+    session_frame_begin(session);
+    while (session_poll_event(session, &event))
     {
       if (event.type == SDL_QUIT)
         quit = 1;
@@ -402,25 +838,87 @@ int main()
       {
         if (event.button.button == SDL_BUTTON_LEFT)
         {
-          mouse_down = 1;
-          handle_mouseclick(im, event.button.x, event.button.y);
+          handle_mouseclick(im, mm, &stroke, event.button.x, event.button.y);
+          update_title(window, bg, &stroke, mm);
         }
+        else if (event.button.button == SDL_BUTTON_RIGHT)
+          pan_down = 1;
+        else if (event.button.button == SDL_BUTTON_MIDDLE)
+          reset_grid_view(bg);
+      }
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_c)
+      {
+        Symmetries *sy = create_symmetries(bg->rows, bg->cols, bg->mapping);
+        bg->state = canonical_form(sy, bg->state, NULL);
+        sync_grid_cells(bg);
+        delete_symmetries(sy);
+      }
+
+      if (event.type == SDL_KEYDOWN && (event.key.keysym.sym == SDLK_s ||
+          event.key.keysym.sym == SDLK_LEFTBRACKET || event.key.keysym.sym == SDLK_RIGHTBRACKET))
+        handle_collection_key(bg, event.key.keysym.sym, &coll_pos);
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_m)
+      {
+        cycle_mapping(bg, ws);
+        update_title(window, bg, &stroke, mm);
       }
 
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_z)
+        restore_history(bg, dm, ws, history_undo(ws));
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_y)
+        restore_history(bg, dm, ws, history_redo(ws));
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_n)
+      {
+        macro_select_next(mm);
+        update_title(window, bg, &stroke, mm);
+      }
+
+      if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p)
+      {
+        stroke.mode = (stroke.mode + 1) % PAINT_MODE_CNT;
+        update_title(window, bg, &stroke, mm);
+      }
+
+      if (event.type == SDL_MOUSEWHEEL)
+        zoom_grid(bg, prev_mx, prev_my, event.wheel.y);
+
+      // motion is only queued, hover and painting run once per frame below
       if (event.type == SDL_MOUSEMOTION)
       {
-        handle_mousemotion(im, event.motion.x, event.motion.y, prev_mx, prev_my, mouse_down);
+        if (pan_down)
+        {
+          bg->view.pan_x += event.motion.x - prev_mx;
+          bg->view.pan_y += event.motion.y - prev_my;
+        }
+        stroke_add_point(&stroke, event.motion.x, event.motion.y);
         prev_mx = event.motion.x;
         prev_my = event.motion.y;
+        moved = 1;
       }
 
       if (event.type == SDL_MOUSEBUTTONUP)
       {
         if (event.button.button == SDL_BUTTON_LEFT)
-          mouse_down = 0;
+          stroke_end(&stroke, bg);
+        else if (event.button.button == SDL_BUTTON_RIGHT)
+          pan_down = 0;
       }
     }
 
+    if (moved)
+    {
+      handle_mousemotion(im, prev_mx, prev_my);
+      stroke_flush(&stroke, bg);
+      moved = 0;
+    }
+
+    select_grid_size(bg, ws, dm->selected);
+    sync_workspace(ws, bg, dm, num, &stroke);
+
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
 
@@ -433,17 +931,22 @@ int main()
           render_block(renderer, font, im, im->items[i].item);
         break;
       case DROPDOWN:
-        render_dropdown(renderer, im, im->items[i].item, &rows, &cols);
+        render_dropdown(renderer, im, im->items[i].item);
         break;
       case GRID:
-        render_grid(renderer, font, im, im->items[i].item, rows, cols);
+        render_grid(renderer, font, im, im->items[i].item);
         break;
       }
     }
 
     SDL_RenderPresent(renderer);
+    session_frame_end(session, bg->rows * bg->cols);
   }
 
+  close_workspace(ws);
+  delete_macro_manager(mm);
   delete_item_manager(im);
+  int status = close_input_session(session);
   clean(window, renderer, font, ALL);
+  return status;
 }
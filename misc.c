@@ -1,5 +1,6 @@
 #include "SDL2/SDL_render.h"
 #include "assert.h"
+#include "alloc_track.h"
 #include "misc.h"
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_ttf.h"
@@ -20,8 +21,6 @@ void clean(SDL_Window* window, SDL_Renderer* renderer, TTF_Font* font, int depth
       TTF_Quit();
     case 0:
       SDL_Quit();
-    default:
-      exit(1);
   }
 }
 
@@ -30,10 +29,11 @@ void error_and_quit(const char* msg, const char* sdl_err, SDL_Window* window,
 {
   fprintf(stderr, "%s: %s\n", msg, sdl_err);
   clean(window, renderer, font, depth);
+  exit(1);
 }
 
 void init(SDL_Window** window, SDL_Renderer** renderer, TTF_Font** font, 
-          int window_width, int window_height)
+          int window_width, int window_height, Uint32 renderer_flags)
 {
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
     error_and_quit("SDL Video Init error", SDL_GetError(), 
@@ -54,7 +54,7 @@ void init(SDL_Window** window, SDL_Renderer** renderer, TTF_Font** font,
     error_and_quit("SDL_CreateWindow error", SDL_GetError(),
                    NULL, NULL, NULL, 1);
 
-  *renderer = SDL_CreateRenderer(*window, -1, SDL_RENDERER_ACCELERATED);
+  *renderer = SDL_CreateRenderer(*window, -1, renderer_flags);
 
   if (*renderer == NULL)
     error_and_quit("SDL_CreateRenderer error", SDL_GetError(),
@@ -77,6 +77,7 @@ SDL_Texture *create_text_texture(SDL_Renderer *renderer, TTF_Font *font,
     SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, s);
     SDL_FreeSurface(s);
     assert(texture);
+    track_texture_create();
     return texture;
   }
   return NULL;
@@ -115,8 +116,7 @@ Block *add_block(SDL_Renderer *r, TTF_Font *f, ItemManager *im, BlockType type,
 
 static void clean_block(Block *b, int manual_alloc)
 {
-  if (b->texture)
-    SDL_DestroyTexture(b->texture);
+  destroy_texture(b->texture);
   if (manual_alloc)
     free(b);
 }
@@ -153,9 +153,12 @@ void add_grid(ItemManager *im, int rows, int cols, int x, int y, int w, int h)
   bg->state.low = bg->state.high = 0;
   bg->rows = rows;
   bg->cols = cols;
+  bg->cap = rows * cols > GRID_POOL_CELLS ? rows * cols : GRID_POOL_CELLS;
   bg->dim = (SDL_Rect){x, y, w, h};
-  bg->grid = malloc(rows * cols * sizeof(Block));
-  for (int i = 0; i < rows * cols; ++i)
+  bg->mapping = LERBEF;
+  bg->view = (Viewport){1, 0, 0, 0, 0, 0};
+  bg->grid = malloc(bg->cap * sizeof(Block));
+  for (int i = 0; i < bg->cap; ++i)
   {
     bg->grid[i].is_hovered = 0;
     bg->grid[i].texture = NULL;
@@ -236,6 +239,12 @@ char *grid_state(const BitGrid *bg, int type)
   return buf;
 }
 
+void grid_dims(int size, int *rows, int *cols)
+{
+  *rows = size == _128BIT ? 8 : 1 << size;
+  *cols = size == _128BIT ? 16 : 8;
+}
+
 ItemManager *create_item_manager(int max_sz)
 {
   ItemManager *im = malloc(sizeof(ItemManager));
@@ -252,13 +261,14 @@ void *find_item(ItemManager *im, ItemType it, BlockType bt)
     switch (it)
     {
     case BLOCK:
-      if (((Block*)im->items[i].item)->type == bt)
+      if (im->items[i].type == BLOCK && ((Block*)im->items[i].item)->type == bt)
         return im->items[i].item;
       break;
     case DROPDOWN:
-      return im->items[i].item;
     case GRID:
-      return im->items[i].item;
+      if (im->items[i].type == it)
+        return im->items[i].item;
+      break;
     }
   }
   return NULL;
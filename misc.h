@@ -7,6 +7,8 @@
 #define INT 0x1
 #define BIN 0x2
 
+#define GRID_POOL_CELLS 128 // cells allocated up front, the largest dropdown size
+
 typedef enum
 {
   _8BIT,
@@ -29,10 +31,30 @@ typedef enum
   FLIP,
   MIRROR,
   CLEAR,
+  REC_MACRO,
+  PLAY_MACRO,
   NUM_DISPLAY,
   BITGRID_BLOCK,
 } BlockType;
 
+// how cell (r, c) of a rows x cols grid, r counted from the top, maps to a
+// bit of the state; rank counts from the bottom, file from the left
+#define SQUARE_MAPPINGS \
+  X(LERF,   (rows - 1 - r) * cols + c) \
+  X(LERBEF, (rows - 1 - r) * cols + (cols - 1 - c)) \
+  X(BERF,   r * cols + c) \
+  X(BERBEF, r * cols + (cols - 1 - c)) \
+  X(LEFR,   c * rows + (rows - 1 - r)) \
+  X(BEFR,   (cols - 1 - c) * rows + r)
+
+typedef enum
+{
+#define X(name, bit) name,
+  SQUARE_MAPPINGS
+#undef X
+  MAPPING_CNT,
+} SquareMapping;
+
 typedef enum
 {
   BLOCK,
@@ -65,12 +87,26 @@ typedef struct
   unsigned long long low;
 } uint128_t;
 
+typedef struct
+{
+  double zoom;  // 1 -> whole grid fits the window
+  double pitch; // px from one cell to the next
+  int pan_x;
+  int pan_y;
+  int ox;       // top left of cell 0
+  int oy;
+  SDL_Rect area; // screen area the grid is clipped to, cells outside it are culled
+} Viewport;
+
 typedef struct
 {
   int rows;
   int cols;
+  int cap; // cells allocated in grid
   uint128_t state;
   SDL_Rect dim; // x,y -> start grid | w,h individual block w/h
+  SquareMapping mapping;
+  Viewport view;
   Block *grid;
 } BitGrid;
 
@@ -96,7 +132,7 @@ void error_and_quit(const char* msg, const char* sdl_err, SDL_Window* window,
                     SDL_Renderer* renderer, TTF_Font* font, int depth);
 
 void init(SDL_Window** window, SDL_Renderer** renderer, TTF_Font** font, 
-          int window_width, int window_height);
+          int window_width, int window_height, Uint32 renderer_flags);
 
 Block *add_block(SDL_Renderer *r, TTF_Font *f, ItemManager *im, BlockType type, 
                int x, int y, int w, int h, SDL_Color c, const char* text);
@@ -108,6 +144,9 @@ void add_grid(ItemManager *im, int rows, int cols, int x, int y, int w, int h);
 
 char *grid_state(const BitGrid *bg, int type);
 
+// rows and cols of a dropdown size, _8BIT .. _128BIT
+void grid_dims(int size, int *rows, int *cols);
+
 ItemManager *create_item_manager(int max_sz);
 
 void *find_item(ItemManager *im, ItemType it, BlockType bt);
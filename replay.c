@@ -0,0 +1,329 @@
+#include "assert.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "replay.h"
+
+#define REC_QUIT 0
+#define REC_BUTTON_DOWN 1
+#define REC_BUTTON_UP 2
+#define REC_MOTION 3
+#define REC_WHEEL 4
+#define REC_KEY 5
+
+static const char *size_names[] = {"8-Bit", "16-Bit", "32-Bit", "64-Bit", "128-Bit"};
+
+static double ms_since(Uint64 t)
+{
+  return (SDL_GetPerformanceCounter() - t) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static int write_record(FILE *fp, const InputRecord *r)
+{
+  return fwrite(&r->frame, sizeof(r->frame), 1, fp) &&
+         fwrite(&r->ms, sizeof(r->ms), 1, fp) &&
+         fwrite(&r->type, sizeof(r->type), 1, fp) &&
+         fwrite(&r->button, sizeof(r->button), 1, fp) &&
+         fwrite(&r->x, sizeof(r->x), 1, fp) &&
+         fwrite(&r->y, sizeof(r->y), 1, fp);
+}
+
+static int read_record(FILE *fp, InputRecord *r)
+{
+  return fread(&r->frame, sizeof(r->frame), 1, fp) &&
+         fread(&r->ms, sizeof(r->ms), 1, fp) &&
+         fread(&r->type, sizeof(r->type), 1, fp) &&
+         fread(&r->button, sizeof(r->button), 1, fp) &&
+         fread(&r->x, sizeof(r->x), 1, fp) &&
+         fread(&r->y, sizeof(r->y), 1, fp);
+}
+
+static int to_record(const SDL_Event *e, InputRecord *r)
+{
+  switch (e->type)
+  {
+  case SDL_QUIT:
+    r->type = REC_QUIT;
+    r->button = 0;
+    r->x = r->y = 0;
+    return 1;
+  case SDL_MOUSEBUTTONDOWN:
+  case SDL_MOUSEBUTTONUP:
+    r->type = e->type == SDL_MOUSEBUTTONDOWN ? REC_BUTTON_DOWN : REC_BUTTON_UP;
+    r->button = e->button.button;
+    r->x = e->button.x;
+    r->y = e->button.y;
+    return 1;
+  case SDL_MOUSEMOTION:
+    r->type = REC_MOTION;
+    r->button = 0;
+    r->x = e->motion.x;
+    r->y = e->motion.y;
+    return 1;
+  case SDL_MOUSEWHEEL:
+    r->type = REC_WHEEL;
+    r->button = 0;
+    r->x = e->wheel.x;
+    r->y = e->wheel.y;
+    return 1;
+  case SDL_KEYDOWN:
+    r->type = REC_KEY;
+    r->button = 0;
+    r->x = e->key.keysym.sym;
+    r->y = 0;
+    return 1;
+  }
+  return 0;
+}
+
+static void from_record(const InputRecord *r, SDL_Event *e)
+{
+  memset(e, 0, sizeof(SDL_Event));
+  e->common.timestamp = r->ms;
+  switch (r->type)
+  {
+  case REC_QUIT:
+    e->type = SDL_QUIT;
+    break;
+  case REC_BUTTON_DOWN:
+  case REC_BUTTON_UP:
+    e->type = r->type == REC_BUTTON_DOWN ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP;
+    e->button.button = r->button;
+    e->button.x = r->x;
+    e->button.y = r->y;
+    break;
+  case REC_MOTION:
+    e->type = SDL_MOUSEMOTION;
+    e->motion.x = r->x;
+    e->motion.y = r->y;
+    break;
+  case REC_WHEEL:
+    e->type = SDL_MOUSEWHEEL;
+    e->wheel.x = r->x;
+    e->wheel.y = r->y;
+    break;
+  case REC_KEY:
+    e->type = SDL_KEYDOWN;
+    e->key.keysym.sym = r->x;
+    break;
+  }
+}
+
+static void add_sample(LatencySamples *ls, double ms)
+{
+  if (ls->cnt >= ls->max_sz)
+  {
+    ls->max_sz = ls->max_sz ? ls->max_sz * 2 : 256;
+    double *new_samples = realloc(ls->samples, ls->max_sz * sizeof(double));
+    assert(new_samples);
+    ls->samples = new_samples;
+  }
+  ls->samples[ls->cnt++] = ms;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+// prints p50/p99/max and returns the p99
+static double report(const char *what, const char *size, LatencySamples *ls)
+{
+  if (!ls->cnt)
+    return 0;
+  qsort(ls->samples, ls->cnt, sizeof(double), cmp_double);
+  double p50 = ls->samples[(ls->cnt - 1) / 2];
+  double p99 = ls->samples[(int)((ls->cnt - 1) * 0.99)];
+  double max = ls->samples[ls->cnt - 1];
+  printf("%-8s %-6s n=%-7d p50=%8.3fms p99=%8.3fms max=%8.3fms\n",
+         size, what, ls->cnt, p50, p99, max);
+  return p99;
+}
+
+static void usage_and_quit(const char *prog)
+{
+  fprintf(stderr, "usage: %s [--workspace name | --record file | --replay file [--budget-ms ms] [--check-allocs] | --dedup in out [bits] [mapping] | --convert in out bits from to | --apply-macro name in out [mapping] | --pack raw out [bits] [mapping] | --unpack in raw]\n", prog);
+  exit(1);
+}
+
+InputSession *open_input_session(int argc, char **argv)
+{
+  InputSession *s = calloc(1, sizeof(InputSession));
+  assert(s);
+  s->mode = SESSION_LIVE;
+  s->workspace = "default";
+  const char *path = NULL;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--check-allocs"))
+    {
+      s->check_allocs = 1;
+      continue;
+    }
+    if (i + 1 >= argc)
+      usage_and_quit(argv[0]);
+    if (!strcmp(argv[i], "--record"))
+      s->mode = SESSION_RECORD;
+    else if (!strcmp(argv[i], "--replay"))
+      s->mode = SESSION_REPLAY;
+    else if (!strcmp(argv[i], "--budget-ms"))
+    {
+      s->budget_ms = atof(argv[++i]);
+      continue;
+    }
+    else if (!strcmp(argv[i], "--workspace"))
+    {
+      s->workspace = argv[++i];
+      continue;
+    }
+    else
+      usage_and_quit(argv[0]);
+    path = argv[++i];
+  }
+
+  if (s->mode == SESSION_LIVE)
+    return s;
+  s->workspace = NULL;
+
+  Uint32 magic = REPLAY_MAGIC, version = REPLAY_VERSION;
+  s->fp = fopen(path, s->mode == SESSION_RECORD ? "wb" : "rb");
+  if (!s->fp)
+  {
+    perror(path);
+    exit(1);
+  }
+
+  if (s->mode == SESSION_RECORD)
+  {
+    fwrite(&magic, sizeof(magic), 1, s->fp);
+    fwrite(&version, sizeof(version), 1, s->fp);
+  }
+  else
+  {
+    if (!fread(&magic, sizeof(magic), 1, s->fp) || magic != REPLAY_MAGIC ||
+        !fread(&version, sizeof(version), 1, s->fp) || version != REPLAY_VERSION)
+    {
+      fprintf(stderr, "%s: not a version %d input recording\n", path, REPLAY_VERSION);
+      exit(1);
+    }
+    s->has_next = read_record(s->fp, &s->next);
+    // no window and no GPU, render through the software renderer
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+  }
+  return s;
+}
+
+int session_poll_event(InputSession *s, SDL_Event *e)
+{
+  if (s->mode != SESSION_REPLAY)
+  {
+    if (!SDL_PollEvent(e))
+      return 0;
+    InputRecord r;
+    if (s->mode == SESSION_RECORD && to_record(e, &r))
+    {
+      r.frame = s->frame;
+      r.ms = (Uint32)ms_since(s->start);
+      write_record(s->fp, &r);
+    }
+    return 1;
+  }
+
+  // keep the queue drained so the dummy driver never backs up
+  SDL_Event ignored;
+  while (SDL_PollEvent(&ignored))
+    ;
+
+  if (!s->has_next)
+  {
+    // recording ended without a quit, stop after the last frame
+    if (s->done)
+      return 0;
+    s->done = 1;
+    memset(e, 0, sizeof(SDL_Event));
+    e->type = SDL_QUIT;
+    return 1;
+  }
+
+  if (s->next.frame > s->frame)
+    return 0;
+
+  from_record(&s->next, e);
+  if (!s->first_input)
+    s->first_input = SDL_GetPerformanceCounter();
+  s->has_next = read_record(s->fp, &s->next);
+  return 1;
+}
+
+void session_frame_begin(InputSession *s)
+{
+  s->frame_start = SDL_GetPerformanceCounter();
+  if (!s->start)
+    s->start = s->frame_start;
+  s->first_input = 0;
+  get_alloc_counts(&s->frame_counts);
+}
+
+void session_frame_end(InputSession *s, int cells)
+{
+  if (s->mode == SESSION_REPLAY)
+  {
+    // a frame with no input after warm up must not touch the heap or textures
+    AllocCounts now;
+    get_alloc_counts(&now);
+    if (s->check_allocs && s->frame >= WARMUP_FRAMES && !s->first_input &&
+        (now.allocs != s->frame_counts.allocs ||
+         now.textures_created != s->frame_counts.textures_created))
+    {
+      if (!s->alloc_frames++)
+        fprintf(stderr, "frame %u: %llu allocs, %llu textures created\n", s->frame,
+                now.allocs - s->frame_counts.allocs,
+                now.textures_created - s->frame_counts.textures_created);
+    }
+
+    int sz = 0;
+    while (sz < _128BIT && (8 << sz) < cells)
+      ++sz;
+    add_sample(&s->frame_lat[sz], ms_since(s->frame_start));
+    if (s->first_input)
+      add_sample(&s->input_lat[sz], ms_since(s->first_input));
+  }
+  s->frame++;
+}
+
+// non zero if the replay went over its latency or allocation budget
+int close_input_session(InputSession *s)
+{
+  int over_budget = 0;
+  if (s->mode == SESSION_REPLAY)
+  {
+    printf("replayed %u frames\n", s->frame);
+    for (int i = 0; i <= _128BIT; ++i)
+    {
+      report("frame", size_names[i], &s->frame_lat[i]);
+      double p99 = report("input", size_names[i], &s->input_lat[i]);
+      if (s->budget_ms > 0 && p99 > s->budget_ms)
+      {
+        fprintf(stderr, "%s input p99 %.3fms over budget %.3fms\n",
+                size_names[i], p99, s->budget_ms);
+        over_budget = 1;
+      }
+    }
+  }
+  if (s->check_allocs && s->alloc_frames)
+  {
+    fprintf(stderr, "%d steady frames allocated\n", s->alloc_frames);
+    over_budget = 1;
+  }
+  for (int i = 0; i <= _128BIT; ++i)
+  {
+    free(s->frame_lat[i].samples);
+    free(s->input_lat[i].samples);
+  }
+  if (s->fp)
+    fclose(s->fp);
+  free(s);
+  return over_budget;
+}
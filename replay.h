@@ -0,0 +1,66 @@
+#pragma once
+
+#include "stdio.h"
+
+#include "alloc_track.h"
+#include "misc.h"
+
+#define REPLAY_MAGIC 0x43524242 // "BBRC"
+#define REPLAY_VERSION 1
+#define WARMUP_FRAMES 60 // frames before allocations count against --check-allocs
+
+typedef enum
+{
+  SESSION_LIVE,
+  SESSION_RECORD,
+  SESSION_REPLAY,
+} SessionMode;
+
+// one event on disk, fields are written one by one (14 bytes)
+typedef struct
+{
+  Uint32 frame;
+  Uint32 ms;
+  Uint8 type;
+  Uint8 button;
+  Sint16 x;
+  Sint16 y;
+} InputRecord;
+
+typedef struct
+{
+  int cnt;
+  int max_sz;
+  double *samples;
+} LatencySamples;
+
+typedef struct
+{
+  SessionMode mode;
+  FILE *fp;
+  Uint32 frame;
+  Uint64 start;
+  Uint64 frame_start;
+  Uint64 first_input;
+  int has_next;
+  int done;
+  double budget_ms;
+  const char *workspace; // live sessions only, replays always start clean
+  int check_allocs;
+  int alloc_frames; // steady frames that allocated
+  AllocCounts frame_counts;
+  InputRecord next;
+  // indexed by grid size, _8BIT .. _128BIT
+  LatencySamples frame_lat[_128BIT + 1];
+  LatencySamples input_lat[_128BIT + 1];
+} InputSession;
+
+InputSession *open_input_session(int argc, char **argv);
+
+int session_poll_event(InputSession *s, SDL_Event *e);
+
+void session_frame_begin(InputSession *s);
+
+void session_frame_end(InputSession *s, int cells);
+
+int close_input_session(InputSession *s);
@@ -1,5 +1,20 @@
 import os
+import struct
 import subprocess
+import sys
+
+# input recordings, see replay.h
+REPLAY_DIR = "replays"
+REPLAY_MAGIC = 0x43524242
+REPLAY_VERSION = 1
+REC_QUIT, REC_BUTTON_DOWN, REC_BUTTON_UP, REC_MOTION = 0, 1, 2, 3
+BUTTON_LEFT = 1
+BUDGET_MS = 16
+
+# positions from init_ui_layout and update_grid_view on the 1280x720 window
+SIZE_MENU = (76, 207)
+SIZE_128BIT = (76, 360)
+GRID_128BIT = (160, 112, 70) # left, top, cell pitch of the 16 x 8 grid
 
 def get_all_c_file_paths_helper(base_dir: str, cur_dir: str, files: list[str]) -> list[str]:
   for file in os.listdir(cur_dir):
@@ -15,15 +30,84 @@ def get_all_c_file_paths(base_dir: str) -> list[str]:
   files: list[str] = []
   return get_all_c_file_paths_helper(base_dir, base_dir, files)
 
+def click(frame: int, x: int, y: int) -> list[tuple]:
+  return [(frame, REC_BUTTON_DOWN, BUTTON_LEFT, x, y), (frame, REC_BUTTON_UP, BUTTON_LEFT, x, y)]
+
+def drag(frame: int, path: list[tuple[int, int]], per_frame: int) -> tuple[list[tuple], int]:
+  recs = [(frame, REC_BUTTON_DOWN, BUTTON_LEFT) + path[0]]
+  for i, p in enumerate(path[1:]):
+    recs.append((frame + 1 + i // per_frame, REC_MOTION, 0) + p)
+  frame = recs[-1][0] + 1
+  recs.append((frame, REC_BUTTON_UP, BUTTON_LEFT) + path[-1])
+  return recs, frame + 1
+
+def lerp_path(points: list[tuple[int, int]], steps: int) -> list[tuple[int, int]]:
+  path = [points[0]]
+  for (x0, y0), (x1, y1) in zip(points, points[1:]):
+    path += [(x0 + (x1 - x0) * i // steps, y0 + (y1 - y0) * i // steps) for i in range(1, steps + 1)]
+  return path
+
+def write_replay(name: str, recs: list[tuple]):
+  os.makedirs(REPLAY_DIR, exist_ok=True)
+  with open(os.path.join(REPLAY_DIR, name), "wb") as f:
+    f.write(struct.pack("<II", REPLAY_MAGIC, REPLAY_VERSION))
+    for frame, type, button, x, y in recs:
+      f.write(struct.pack("<IIBBhh", frame, frame * 16, type, button, x, y))
+
+# switches to the 128-bit grid and drags across all of it: a zigzag over every
+# row, then the diagonals
+def drag128() -> list[tuple]:
+  x, y, pitch = GRID_128BIT
+  rows = [(x + pitch // 2 + (15 * pitch if r % 2 else 0), y + pitch // 2 + r * pitch) for r in range(8)]
+  corners = [(x + 5, y + 5), (x + 16 * pitch - 5, y + 8 * pitch - 5), (x + 16 * pitch - 5, y + 5),
+             (x + 5, y + 8 * pitch - 5)]
+  recs = click(1, *SIZE_MENU) + click(2, *SIZE_128BIT)
+  frame = 10
+  for points in [rows, corners]:
+    d, frame = drag(frame, lerp_path(points, 24), 4)
+    recs += d
+  return recs + [(frame + 10, REC_QUIT, 0, 0, 0)]
+
+# idles past the warm up on the 128-bit grid, drags one row and idles again,
+# so --check-allocs sees steady frames on both sides of the drag
+def idle128() -> list[tuple]:
+  x, y, pitch = GRID_128BIT
+  row = [(x + pitch // 2, y + pitch // 2), (x + 16 * pitch - pitch // 2, y + pitch // 2)]
+  recs = click(1, *SIZE_MENU) + click(2, *SIZE_128BIT)
+  d, frame = drag(200, lerp_path(row, 60), 2)
+  return recs + d + [(frame + 300, REC_QUIT, 0, 0, 0)]
+
+def make_replays():
+  write_replay("drag128.bbrc", drag128())
+  write_replay("idle128.bbrc", idle128())
+
+def run_replays(exec_name: str) -> int:
+  status = 0
+  for name in sorted(os.listdir(REPLAY_DIR)):
+    res = subprocess.run(f"./{exec_name} --replay {os.path.join(REPLAY_DIR, name)} --budget-ms {BUDGET_MS} --check-allocs", shell=True)
+    status = status or res.returncode
+  return status
+
+# python run.py          build and check for leaks (mac)
+# python run.py replay   build and replay the recordings in replays/ against the
+#                        latency budget and with no allocations in idle frames
+# python run.py replays  regenerate the recordings
 def main():
+  if sys.argv[1:] == ["replays"]:
+    make_replays()
+    return
+
   exec_name = "main"
   files: str = ' '.join(get_all_c_file_paths(os.getcwd()))
-  res = subprocess.run(f"clang -o {exec_name} {files} -lSDL2_ttf $(sdl2-config --cflags --libs)", shell=True)
+  res = subprocess.run(f"clang -o {exec_name} {files} -lSDL2_ttf -lm $(sdl2-config --cflags --libs)", shell=True)
   if res.returncode == 0:
     print(f"Compiled {files} -> {exec_name}")
   else:
     print("Dramatic error compiling")
+    sys.exit(1)
 
+  if sys.argv[1:] == ["replay"]:
+    sys.exit(run_replays(exec_name))
   subprocess.run(f"leaks --atExit -- ./{exec_name}", shell=True)
 
 if __name__ == "__main__":
@@ -0,0 +1,123 @@
+#include "math.h"
+#include "stdlib.h"
+
+#include "stroke.h"
+#include "transform.h"
+
+const char *paint_mode_names[] = {"Toggle", "Set", "Clear"};
+
+// cells are collected by index, bit j for cell j, and turned into state bits
+// once per flush by the mapping's kernel
+static void add_cell(const BitGrid *bg, int col, int row, uint128_t *cells)
+{
+  int j = row * bg->cols + col;
+  if (row < 0 || row >= bg->rows || col < 0 || col >= bg->cols || j >= 128)
+    return;
+
+  // cells render_grid culls, e.g. under the toolbar when panned, stay as they are
+  const Viewport *v = &bg->view;
+  double x = v->ox + col * v->pitch, y = v->oy + row * v->pitch;
+  if (x + v->pitch <= v->area.x || x >= v->area.x + v->area.w ||
+      y + v->pitch <= v->area.y || y >= v->area.y + v->area.h)
+    return;
+  if (j >= 64)
+    cells->high |= 1ULL << (j - 64);
+  else
+    cells->low |= 1ULL << j;
+}
+
+// Amanatides-Woo walk: every cell the segment passes through, in cell units
+static void rasterize(const BitGrid *bg, SDL_Point a, SDL_Point b, uint128_t *cells)
+{
+  const Viewport *v = &bg->view;
+  double x0 = (a.x - v->ox) / v->pitch, y0 = (a.y - v->oy) / v->pitch,
+         x1 = (b.x - v->ox) / v->pitch, y1 = (b.y - v->oy) / v->pitch;
+  int cx = (int)floor(x0), cy = (int)floor(y0);
+  int steps = abs((int)floor(x1) - cx) + abs((int)floor(y1) - cy);
+  double dx = x1 - x0, dy = y1 - y0;
+  int sx = dx > 0 ? 1 : -1, sy = dy > 0 ? 1 : -1;
+  double tdx = dx != 0 ? fabs(1 / dx) : INFINITY, tdy = dy != 0 ? fabs(1 / dy) : INFINITY;
+  double tmx = dx != 0 ? (sx > 0 ? cx + 1 - x0 : x0 - cx) * tdx : INFINITY,
+         tmy = dy != 0 ? (sy > 0 ? cy + 1 - y0 : y0 - cy) * tdy : INFINITY;
+
+  add_cell(bg, cx, cy, cells);
+  for (int i = 0; i < steps; ++i)
+  {
+    if (tmx < tmy)
+    {
+      tmx += tdx;
+      cx += sx;
+    }
+    else
+    {
+      tmy += tdy;
+      cy += sy;
+    }
+    add_cell(bg, cx, cy, cells);
+  }
+}
+
+static void apply_mask(Stroke *s, BitGrid *bg, uint128_t mask)
+{
+  switch (s->mode)
+  {
+  case PAINT_TOGGLE:
+    bg->state.high ^= mask.high & ~s->touched.high;
+    bg->state.low ^= mask.low & ~s->touched.low;
+    break;
+  case PAINT_SET:
+    bg->state.high |= mask.high;
+    bg->state.low |= mask.low;
+    break;
+  case PAINT_CLEAR:
+    bg->state.high &= ~mask.high;
+    bg->state.low &= ~mask.low;
+    break;
+  default:
+    break;
+  }
+  s->touched.high |= mask.high;
+  s->touched.low |= mask.low;
+  sync_grid_cells(bg);
+}
+
+void stroke_begin(Stroke *s, BitGrid *bg, int x, int y)
+{
+  uint128_t cells = {0, 0};
+  s->active = 1;
+  s->touched = (uint128_t){0, 0};
+  s->pts[0] = (SDL_Point){x, y};
+  s->pt_cnt = 1;
+  rasterize(bg, s->pts[0], s->pts[0], &cells);
+  apply_mask(s, bg, cells_mask(bg, cells));
+}
+
+void stroke_add_point(Stroke *s, int x, int y)
+{
+  if (!s->active)
+    return;
+  // out of room, replace the previous point so the tail of the path becomes
+  // one straight segment instead of losing the newest position
+  if (s->pt_cnt == MAX_STROKE_POINTS)
+    s->pt_cnt--;
+  s->pts[s->pt_cnt++] = (SDL_Point){x, y};
+}
+
+// one mask for the whole polyline, then one update of the board
+void stroke_flush(Stroke *s, BitGrid *bg)
+{
+  if (!s->active || s->pt_cnt < 2)
+    return;
+  uint128_t cells = {0, 0};
+  for (int i = 1; i < s->pt_cnt; ++i)
+    rasterize(bg, s->pts[i - 1], s->pts[i], &cells);
+  apply_mask(s, bg, cells_mask(bg, cells));
+  s->pts[0] = s->pts[s->pt_cnt - 1];
+  s->pt_cnt = 1;
+}
+
+void stroke_end(Stroke *s, BitGrid *bg)
+{
+  stroke_flush(s, bg);
+  s->active = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "misc.h"
+
+#define MAX_STROKE_POINTS 256
+
+typedef enum
+{
+  PAINT_TOGGLE,
+  PAINT_SET,
+  PAINT_CLEAR,
+  PAINT_MODE_CNT,
+} PaintMode;
+
+// a drag across the grid; motion is only queued here and rasterized once per
+// frame, every cell touched by the stroke is painted at most once
+typedef struct
+{
+  int active;
+  PaintMode mode;
+  int pt_cnt;
+  SDL_Point pts[MAX_STROKE_POINTS];
+  uint128_t touched;
+} Stroke;
+
+extern const char *paint_mode_names[];
+
+void stroke_begin(Stroke *s, BitGrid *bg, int x, int y);
+
+void stroke_add_point(Stroke *s, int x, int y);
+
+void stroke_flush(Stroke *s, BitGrid *bg);
+
+void stroke_end(Stroke *s, BitGrid *bg);
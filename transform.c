@@ -0,0 +1,459 @@
+#include "assert.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "transform.h"
+
+#define MAX_CELLS 128
+#define MACRO_LINE_SZ 1024
+
+int is_transform(BlockType type)
+{
+  return type >= ROT_LEFT && type <= MIRROR;
+}
+
+const char *mapping_names[] = {
+#define X(name, bit) #name,
+  SQUARE_MAPPINGS
+#undef X
+};
+
+// button labels, indexed from ROT_LEFT
+static const char *step_names[] = {"RL", "RR", "N", "NE", "E", "SE", "S", "SW", "W", "NW",
+                                   "Flip", "Mir"};
+
+static int name_index(const char **names, int cnt, const char *name)
+{
+  for (int i = 0; i < cnt; ++i)
+    if (!strcmp(names[i], name))
+      return i;
+  return -1;
+}
+
+static int test_bit(uint128_t s, int bit)
+{
+  if (bit < 0 || bit >= 128)
+    return 0;
+  return bit >= 64 ? (s.high >> (bit - 64)) & 1 : (s.low >> bit) & 1;
+}
+
+static void set_bit(uint128_t *s, int bit)
+{
+  if (bit >= 64)
+    s->high |= 1ULL << (bit - 64);
+  else
+    s->low |= 1ULL << bit;
+}
+
+// one kernel set per mapping, so the loops inline the bit formula instead of
+// switching on the mapping for every cell
+#define X(name, bit)                                                          \
+  static int cell_bit_##name(int rows, int cols, int j)                       \
+  {                                                                           \
+    int r = j / cols, c = j % cols;                                           \
+    return bit;                                                               \
+  }                                                                           \
+                                                                              \
+  static void sync_##name(BitGrid *bg)                                        \
+  {                                                                           \
+    for (int j = 0; j < bg->rows * bg->cols; ++j)                             \
+      bg->grid[j].is_hovered = test_bit(bg->state,                            \
+                                        cell_bit_##name(bg->rows, bg->cols, j)); \
+  }                                                                           \
+                                                                              \
+  static uint128_t remap_##name(const int *src, int rows, int cols,           \
+                                uint128_t state)                              \
+  {                                                                           \
+    uint128_t out = {0, 0};                                                   \
+    for (int d = 0; d < rows * cols; ++d)                                     \
+      if (src[d] >= 0 && test_bit(state, cell_bit_##name(rows, cols, src[d])))\
+        set_bit(&out, cell_bit_##name(rows, cols, d));                        \
+    return out;                                                               \
+  }                                                                           \
+                                                                              \
+  static int count_##name(const BitGrid *bg, int j, int len)                  \
+  {                                                                           \
+    int cnt = 0;                                                              \
+    for (int i = j; i < j + len; ++i)                                         \
+      cnt += test_bit(bg->state, cell_bit_##name(bg->rows, bg->cols, i));     \
+    return cnt;                                                               \
+  }                                                                           \
+                                                                              \
+  static uint128_t cells_##name(int rows, int cols, uint128_t cells)          \
+  {                                                                           \
+    uint128_t out = {0, 0};                                                   \
+    for (int k = 0; k < 2; ++k)                                               \
+      for (unsigned long long w = k ? cells.high : cells.low; w; w &= w - 1)  \
+        set_bit(&out, cell_bit_##name(rows, cols, 64 * k + __builtin_ctzll(w)));\
+    return out;                                                               \
+  }
+SQUARE_MAPPINGS
+#undef X
+
+typedef struct
+{
+  int (*cell_bit)(int rows, int cols, int j);
+  void (*sync)(BitGrid *bg);
+  uint128_t (*remap)(const int *src, int rows, int cols, uint128_t state);
+  int (*count)(const BitGrid *bg, int j, int len);
+  uint128_t (*cells)(int rows, int cols, uint128_t cells);
+} MappingKernels;
+
+static const MappingKernels kernels[] = {
+#define X(name, bit) {cell_bit_##name, sync_##name, remap_##name, count_##name, cells_##name},
+  SQUARE_MAPPINGS
+#undef X
+};
+
+int mapping_bit(SquareMapping m, int rows, int cols, int j)
+{
+  return kernels[m].cell_bit(rows, cols, j);
+}
+
+int get_cell(const BitGrid *bg, int j)
+{
+  return test_bit(bg->state, mapping_bit(bg->mapping, bg->rows, bg->cols, j));
+}
+
+// cells has bit j set for every cell j to include
+uint128_t cells_mask(const BitGrid *bg, uint128_t cells)
+{
+  return kernels[bg->mapping].cells(bg->rows, bg->cols, cells);
+}
+
+// every mapping puts the cells on bits 0 .. rows * cols - 1
+uint128_t grid_mask(const BitGrid *bg)
+{
+  int n = bg->rows * bg->cols;
+  return (uint128_t){n >= 128 ? ~0ULL : n > 64 ? (1ULL << (n - 64)) - 1 : 0,
+                     n >= 64 ? ~0ULL : (1ULL << n) - 1};
+}
+
+static int popcount_word(unsigned long long w, int lo, int hi)
+{
+  if (lo > hi)
+    return 0;
+  unsigned long long m = hi - lo == 63 ? ~0ULL : ((1ULL << (hi - lo + 1)) - 1) << lo;
+  return __builtin_popcountll(w & m);
+}
+
+int count_cells(const BitGrid *bg, int row, int col, int len)
+{
+  int j = row * bg->cols + col;
+  int first = mapping_bit(bg->mapping, bg->rows, bg->cols, j),
+      last = mapping_bit(bg->mapping, bg->rows, bg->cols, j + len - 1);
+
+  // rank major mappings keep a row as one run of bits, popcount it
+  if (abs(last - first) == len - 1)
+  {
+    int lo = first < last ? first : last, hi = first < last ? last : first;
+    lo = lo < 0 ? 0 : lo;
+    hi = hi > 127 ? 127 : hi;
+    return popcount_word(bg->state.low, lo, hi < 63 ? hi : 63) +
+           popcount_word(bg->state.high, (lo > 64 ? lo : 64) - 64, hi - 64);
+  }
+
+  return kernels[bg->mapping].count(bg, j, len);
+}
+
+void sync_grid_cells(BitGrid *bg)
+{
+  kernels[bg->mapping].sync(bg);
+}
+
+// src[d] = cell that lands on cell d, or -1 if d is vacated
+// rotations only permute square grids, on others they are a no-op
+static void transform_map(BlockType type, int rows, int cols, int *src)
+{
+  int dr = 0, dc = 0;
+  switch (type)
+  {
+  case MOVE_NORTH:     dr =  1;          break;
+  case MOVE_NORTHEAST: dr =  1; dc = -1; break;
+  case MOVE_EAST:               dc = -1; break;
+  case MOVE_SOUTHEAST: dr = -1; dc = -1; break;
+  case MOVE_SOUTH:     dr = -1;          break;
+  case MOVE_SOUTHWEST: dr = -1; dc =  1; break;
+  case MOVE_WEST:               dc =  1; break;
+  case MOVE_NORTHWEST: dr =  1; dc =  1; break;
+  default: break;
+  }
+
+  for (int r = 0; r < rows; ++r)
+  {
+    for (int c = 0; c < cols; ++c)
+    {
+      int sr = r + dr, sc = c + dc;
+      if (type == ROT_LEFT && rows == cols)
+      {
+        sr = c;
+        sc = cols - 1 - r;
+      }
+      else if (type == ROT_RIGHT && rows == cols)
+      {
+        sr = rows - 1 - c;
+        sc = r;
+      }
+      else if (type == FLIP)
+        sr = rows - 1 - r;
+      else if (type == MIRROR)
+        sc = cols - 1 - c;
+
+      if (sr < 0 || sr >= rows || sc < 0 || sc >= cols)
+        src[r * cols + c] = -1;
+      else
+        src[r * cols + c] = sr * cols + sc;
+    }
+  }
+}
+
+uint128_t apply_transform(BlockType type, const BitGrid *bg)
+{
+  int src[MAX_CELLS];
+  assert(bg->rows * bg->cols <= MAX_CELLS);
+  transform_map(type, bg->rows, bg->cols, src);
+  return kernels[bg->mapping].remap(src, bg->rows, bg->cols, bg->state);
+}
+
+// one macro per line: name rows cols mapping step step ...
+static Macro *parse_macro(char *line)
+{
+  const char *sep = " \t\r\n";
+  char *name = strtok(line, sep), *rows = strtok(NULL, sep), *cols = strtok(NULL, sep),
+       *mapping = strtok(NULL, sep);
+  int from = mapping ? name_index(mapping_names, MAPPING_CNT, mapping) : -1;
+  if (from < 0)
+    return NULL;
+
+  Macro *m = malloc(sizeof(Macro));
+  assert(m);
+  snprintf(m->name, MACRO_NAME_SZ, "%s", name);
+  m->rows = atoi(rows);
+  m->cols = atoi(cols);
+  m->from = m->to = from;
+  m->step_cnt = 0;
+  for (char *t = strtok(NULL, sep); t; t = strtok(NULL, sep))
+  {
+    int step = name_index(step_names, MIRROR - ROT_LEFT + 1, t);
+    if (step < 0 || m->step_cnt == MAX_MACRO_STEPS)
+      m->rows = 0;
+    else
+      m->steps[m->step_cnt++] = ROT_LEFT + step;
+  }
+  if (m->rows < 1 || m->cols < 1 || m->rows * m->cols > MAX_CELLS)
+  {
+    free(m);
+    return NULL;
+  }
+  macro_compile(m);
+  return m;
+}
+
+static void load_macros(MacroManager *mm)
+{
+  FILE *fp = fopen(mm->path, "r");
+  if (!fp)
+    return;
+  char line[MACRO_LINE_SZ];
+  for (int n = 1; fgets(line, sizeof(line), fp); ++n)
+  {
+    if (line[strspn(line, " \t\r\n")] == '\0')
+      continue;
+    Macro *m = parse_macro(line);
+    if (!m)
+      fprintf(stderr, "%s:%d: not a macro, skipped\n", mm->path, n);
+    else if (mm->macro_cnt == MAX_MACROS)
+    {
+      fprintf(stderr, "%s:%d: only %d macros are kept, skipped\n", mm->path, n, MAX_MACROS);
+      free(m);
+    }
+    else
+      mm->macros[mm->macro_cnt++] = m;
+  }
+  fclose(fp);
+}
+
+MacroManager *create_macro_manager(const char *path)
+{
+  MacroManager *mm = malloc(sizeof(MacroManager));
+  mm->recording = 0;
+  mm->macro_cnt = 0;
+  mm->selected = 0;
+  mm->next_id = 1;
+  mm->path = path;
+  if (path)
+    load_macros(mm);
+  return mm;
+}
+
+Macro *macro_begin(MacroManager *mm, int rows, int cols, SquareMapping mapping)
+{
+  if (rows * cols > MAX_CELLS)
+    return NULL;
+  if (mm->macro_cnt == MAX_MACROS)
+  {
+    printf("all %d macro slots used, replacing %s\n", MAX_MACROS, mm->macros[0]->name);
+    free(mm->macros[0]);
+    memmove(mm->macros, mm->macros + 1, (MAX_MACROS - 1) * sizeof(Macro*));
+    mm->macro_cnt--;
+    mm->selected = mm->selected ? mm->selected - 1 : 0;
+  }
+
+  Macro *m = malloc(sizeof(Macro));
+  assert(m);
+  // skip names still taken by loaded macros
+  do
+    snprintf(m->name, MACRO_NAME_SZ, "M%d", mm->next_id++);
+  while (find_macro(mm, m->name));
+  m->rows = rows;
+  m->cols = cols;
+  m->from = m->to = mapping;
+  m->step_cnt = 0;
+  mm->macros[mm->macro_cnt] = m;
+  mm->recording = 1;
+  return m;
+}
+
+// steps applied on a grid of another size than the recording's are not part
+// of it, replaying them on the recorded size would do something never seen
+void macro_record(MacroManager *mm, BlockType type, int rows, int cols)
+{
+  if (!mm->recording || !is_transform(type))
+    return;
+  Macro *m = mm->macros[mm->macro_cnt];
+  if (m->rows == rows && m->cols == cols && m->step_cnt < MAX_MACRO_STEPS)
+    m->steps[m->step_cnt++] = type;
+}
+
+// composes every step into one cell map, then expands it to a byte indexed
+// table so replay is 16 lookups no matter how long the chain was, reading
+// bits in the from mapping and writing them in the to mapping
+void macro_compile(Macro *m)
+{
+  int n = m->rows * m->cols;
+  int map[MAX_CELLS], step[MAX_CELLS], tmp[MAX_CELLS];
+  for (int d = 0; d < n; ++d)
+    map[d] = d;
+
+  for (int i = 0; i < m->step_cnt; ++i)
+  {
+    transform_map(m->steps[i], m->rows, m->cols, step);
+    for (int d = 0; d < n; ++d)
+      tmp[d] = step[d] >= 0 ? map[step[d]] : -1;
+    memcpy(map, tmp, n * sizeof(int));
+  }
+
+  memset(m->table, 0, sizeof(m->table));
+  for (int d = 0; d < n; ++d)
+  {
+    if (map[d] < 0)
+      continue;
+    int sb = mapping_bit(m->from, m->rows, m->cols, map[d]),
+        db = mapping_bit(m->to, m->rows, m->cols, d);
+    for (int v = 0; v < 256; ++v)
+      if (v & (1 << (sb % 8)))
+        set_bit(&m->table[sb / 8][v], db);
+  }
+}
+
+Macro *macro_end(MacroManager *mm)
+{
+  if (!mm->recording)
+    return NULL;
+  mm->recording = 0;
+  mm->selected = mm->macro_cnt;
+  Macro *m = mm->macros[mm->macro_cnt++];
+  macro_compile(m);
+  if (save_macros(mm))
+    perror(mm->path);
+  return m;
+}
+
+// the steps only describe cells, so a macro can be rebuilt for any mapping
+void macro_set_mapping(Macro *m, SquareMapping mapping)
+{
+  if (m->from == mapping && m->to == mapping)
+    return;
+  m->from = m->to = mapping;
+  macro_compile(m);
+}
+
+Macro *macro_selected(const MacroManager *mm)
+{
+  return mm->macro_cnt ? mm->macros[mm->selected] : NULL;
+}
+
+void macro_select_next(MacroManager *mm)
+{
+  if (mm->macro_cnt)
+    mm->selected = (mm->selected + 1) % mm->macro_cnt;
+}
+
+Macro *find_macro(const MacroManager *mm, const char *name)
+{
+  for (int i = 0; i < mm->macro_cnt; ++i)
+    if (!strcmp(mm->macros[i]->name, name))
+      return mm->macros[i];
+  return NULL;
+}
+
+int save_macros(const MacroManager *mm)
+{
+  if (!mm->path)
+    return 0;
+  FILE *fp = fopen(mm->path, "w");
+  if (!fp)
+    return -1;
+  for (int i = 0; i < mm->macro_cnt; ++i)
+  {
+    const Macro *m = mm->macros[i];
+    fprintf(fp, "%s %d %d %s", m->name, m->rows, m->cols, mapping_names[m->from]);
+    for (int k = 0; k < m->step_cnt; ++k)
+      fprintf(fp, " %s", step_names[m->steps[k] - ROT_LEFT]);
+    fprintf(fp, "\n");
+  }
+  return fclose(fp) ? -1 : 0;
+}
+
+Macro *create_remap(int rows, int cols, SquareMapping from, SquareMapping to)
+{
+  Macro *m = malloc(sizeof(Macro));
+  assert(m && rows * cols <= MAX_CELLS);
+  snprintf(m->name, MACRO_NAME_SZ, "%s>%s", mapping_names[from], mapping_names[to]);
+  m->rows = rows;
+  m->cols = cols;
+  m->from = from;
+  m->to = to;
+  m->step_cnt = 0;
+  macro_compile(m);
+  return m;
+}
+
+uint128_t macro_apply(const Macro *m, uint128_t state)
+{
+  uint128_t out = {0, 0};
+  for (int k = 0; k < 8; ++k)
+  {
+    const uint128_t *lo = &m->table[k][(state.low >> (8 * k)) & 0xff];
+    const uint128_t *hi = &m->table[k + 8][(state.high >> (8 * k)) & 0xff];
+    out.low |= lo->low | hi->low;
+    out.high |= lo->high | hi->high;
+  }
+  return out;
+}
+
+void macro_apply_all(const Macro *m, uint128_t *boards, size_t n)
+{
+  for (size_t i = 0; i < n; ++i)
+    boards[i] = macro_apply(m, boards[i]);
+}
+
+void delete_macro_manager(MacroManager *mm)
+{
+  // a macro still being recorded is owned at macros[macro_cnt]
+  int cnt = mm->macro_cnt + mm->recording;
+  for (int i = 0; i < cnt; ++i)
+    free(mm->macros[i]);
+  free(mm);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "misc.h"
+
+#define MAX_MACROS 8
+#define MAX_MACRO_STEPS 64
+#define MACRO_NAME_SZ 16
+
+// Cell j of a rows x cols grid is row major, top left first. Which bit of
+// the 128-bit state it is depends on the grid's SquareMapping.
+
+typedef struct
+{
+  char name[MACRO_NAME_SZ];
+  int rows;
+  int cols;
+  SquareMapping from;
+  SquareMapping to;
+  int step_cnt;
+  BlockType steps[MAX_MACRO_STEPS];
+  // fused form: output = OR of table[k][byte k of input] over all 16 bytes
+  uint128_t table[16][256];
+} Macro;
+
+// macros[0] is the oldest; once all slots are used a new recording replaces it
+typedef struct
+{
+  int recording;
+  int macro_cnt;
+  int selected; // the macro Play runs
+  int next_id;  // for naming new recordings M1, M2, ...
+  const char *path; // macros are loaded from and saved to this file, NULL keeps them in memory
+  Macro *macros[MAX_MACROS];
+} MacroManager;
+
+extern const char *mapping_names[];
+
+int is_transform(BlockType type);
+
+int mapping_bit(SquareMapping m, int rows, int cols, int j);
+
+int get_cell(const BitGrid *bg, int j);
+
+uint128_t cells_mask(const BitGrid *bg, uint128_t cells);
+
+uint128_t grid_mask(const BitGrid *bg);
+
+int count_cells(const BitGrid *bg, int row, int col, int len);
+
+void sync_grid_cells(BitGrid *bg);
+
+uint128_t apply_transform(BlockType type, const BitGrid *bg);
+
+MacroManager *create_macro_manager(const char *path);
+
+Macro *macro_begin(MacroManager *mm, int rows, int cols, SquareMapping mapping);
+
+void macro_record(MacroManager *mm, BlockType type, int rows, int cols);
+
+Macro *macro_end(MacroManager *mm);
+
+void macro_compile(Macro *m);
+
+void macro_set_mapping(Macro *m, SquareMapping mapping);
+
+Macro *macro_selected(const MacroManager *mm);
+
+void macro_select_next(MacroManager *mm);
+
+Macro *find_macro(const MacroManager *mm, const char *name);
+
+int save_macros(const MacroManager *mm);
+
+Macro *create_remap(int rows, int cols, SquareMapping from, SquareMapping to);
+
+uint128_t macro_apply(const Macro *m, uint128_t state);
+
+void macro_apply_all(const Macro *m, uint128_t *boards, size_t n);
+
+void delete_macro_manager(MacroManager *mm);
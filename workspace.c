@@ -0,0 +1,181 @@
+#include "assert.h"
+#include "fcntl.h"
+#include "stdio.h"
+#include "sys/file.h"
+#include "sys/mman.h"
+#include "unistd.h"
+
+#include "stroke.h"
+#include "transform.h"
+#include "workspace.h"
+
+static void reset_snapshot(Snapshot *s)
+{
+  memset(s, 0, sizeof(Snapshot));
+  s->magic = WORKSPACE_MAGIC;
+  s->version = WORKSPACE_VERSION;
+  s->selected = _64BIT;
+  s->display = HEX;
+  s->mapping = LERBEF;
+  s->hist_cnt = 1;
+  s->history[0].size = _64BIT;
+}
+
+// every field is used as an index somewhere, a file that fails any check
+// starts over
+static int valid_snapshot(const Snapshot *s)
+{
+  int ok = s->magic == WORKSPACE_MAGIC && s->version == WORKSPACE_VERSION &&
+           s->selected >= _8BIT && s->selected <= _128BIT &&
+           s->display >= HEX && s->display <= BIN &&
+           s->mapping >= 0 && s->mapping < MAPPING_CNT &&
+           s->paint_mode >= 0 && s->paint_mode < PAINT_MODE_CNT &&
+           s->hist_cnt >= 1 && s->hist_cnt <= HISTORY_SZ &&
+           s->hist_pos >= 0 && s->hist_pos < s->hist_cnt &&
+           s->hist_head >= 0 && s->hist_head < HISTORY_SZ;
+  for (int i = 0; ok && i < s->hist_cnt; ++i)
+  {
+    int size = s->history[(s->hist_head + i) % HISTORY_SZ].size;
+    ok = size >= _8BIT && size <= _128BIT;
+  }
+  return ok;
+}
+
+Workspace *open_workspace(const char *name)
+{
+  Workspace *ws = malloc(sizeof(Workspace));
+  ws->mapped = 0;
+  ws->dirty = 0;
+  ws->fd = -1;
+  ws->snap = NULL;
+
+  if (name)
+  {
+    char path[256];
+    snprintf(path, sizeof(path), "%s.bbws", name);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    // two editors on one mapping would push each other's boards every frame
+    if (fd >= 0 && flock(fd, LOCK_EX | LOCK_NB))
+    {
+      fprintf(stderr, "%s is open in another editor, this session will not be saved\n", path);
+      ws->snap = malloc(sizeof(Snapshot));
+      assert(ws->snap);
+      if (pread(fd, ws->snap, sizeof(Snapshot), 0) != sizeof(Snapshot))
+        reset_snapshot(ws->snap);
+    }
+    else if (fd >= 0 && ftruncate(fd, sizeof(Snapshot)) == 0)
+    {
+      void *p = mmap(NULL, sizeof(Snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (p != MAP_FAILED)
+      {
+        ws->snap = p;
+        ws->mapped = 1;
+        ws->fd = fd;
+      }
+      else
+        perror(path);
+    }
+    else
+      perror(path);
+    if (fd >= 0 && !ws->mapped)
+      close(fd);
+  }
+
+  if (!ws->snap)
+  {
+    ws->snap = malloc(sizeof(Snapshot));
+    assert(ws->snap);
+    reset_snapshot(ws->snap);
+  }
+  else if (!valid_snapshot(ws->snap))
+    reset_snapshot(ws->snap);
+  return ws;
+}
+
+const HistoryEntry *history_current(const Workspace *ws)
+{
+  const Snapshot *s = ws->snap;
+  return &s->history[(s->hist_head + s->hist_pos) % HISTORY_SZ];
+}
+
+// drops any redo entries, and the oldest entry once the ring is full
+void history_push(Workspace *ws, int size, uint128_t state)
+{
+  Snapshot *s = ws->snap;
+  s->hist_cnt = s->hist_pos + 1;
+  if (s->hist_cnt == HISTORY_SZ)
+  {
+    s->hist_head = (s->hist_head + 1) % HISTORY_SZ;
+    s->hist_cnt--;
+    s->hist_pos--;
+  }
+  HistoryEntry *e = &s->history[(s->hist_head + s->hist_cnt) % HISTORY_SZ];
+  e->size = size;
+  e->state = state;
+  s->hist_cnt++;
+  s->hist_pos++;
+  ws->dirty = 1;
+}
+
+const HistoryEntry *history_undo(Workspace *ws)
+{
+  if (ws->snap->hist_pos == 0)
+    return NULL;
+  ws->snap->hist_pos--;
+  ws->dirty = 1;
+  return history_current(ws);
+}
+
+const HistoryEntry *history_redo(Workspace *ws)
+{
+  if (ws->snap->hist_pos + 1 >= ws->snap->hist_cnt)
+    return NULL;
+  ws->snap->hist_pos++;
+  ws->dirty = 1;
+  return history_current(ws);
+}
+
+// every stored board is kept in the editor's mapping, so a mapping change
+// rewrites all of them, history included
+void workspace_remap(Workspace *ws, SquareMapping from, SquareMapping to)
+{
+  Snapshot *s = ws->snap;
+  for (int size = _8BIT; size <= _128BIT; ++size)
+  {
+    int rows, cols;
+    grid_dims(size, &rows, &cols);
+    Macro *m = create_remap(rows, cols, from, to);
+    s->boards[size] = macro_apply(m, s->boards[size]);
+    for (int i = 0; i < s->hist_cnt; ++i)
+    {
+      HistoryEntry *e = &s->history[(s->hist_head + i) % HISTORY_SZ];
+      if (e->size == size)
+        e->state = macro_apply(m, e->state);
+    }
+    free(m);
+  }
+  s->mapping = to;
+  ws->dirty = 1;
+}
+
+// stores already landed in the mapping, this only asks the kernel to start
+// writing the dirty pages
+void workspace_flush(Workspace *ws)
+{
+  if (ws->mapped && ws->dirty)
+    msync(ws->snap, sizeof(Snapshot), MS_ASYNC);
+  ws->dirty = 0;
+}
+
+void close_workspace(Workspace *ws)
+{
+  if (ws->mapped)
+  {
+    msync(ws->snap, sizeof(Snapshot), MS_SYNC);
+    munmap(ws->snap, sizeof(Snapshot));
+    close(ws->fd);
+  }
+  else
+    free(ws->snap);
+  free(ws);
+}
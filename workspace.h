@@ -0,0 +1,56 @@
+#pragma once
+
+#include "misc.h"
+
+#define WORKSPACE_MAGIC 0x53574242 // "BBWS"
+#define WORKSPACE_VERSION 1
+#define HISTORY_SZ 256
+
+typedef struct
+{
+  int size; // dropdown index, _8BIT .. _128BIT
+  uint128_t state;
+} HistoryEntry;
+
+// the file is this struct byte for byte, mapped shared so stores to it are
+// the write back; bump WORKSPACE_VERSION on any layout change
+typedef struct
+{
+  unsigned int magic;
+  unsigned int version;
+  int selected;
+  int display;
+  int mapping;
+  int paint_mode;
+  uint128_t boards[_128BIT + 1];
+  int hist_head; // oldest entry
+  int hist_cnt;
+  int hist_pos;  // current entry, counted from hist_head
+  HistoryEntry history[HISTORY_SZ];
+} Snapshot;
+
+typedef struct
+{
+  int mapped;
+  int dirty;
+  int fd; // held open for its lock while mapped, -1 otherwise
+  Snapshot *snap;
+} Workspace;
+
+// name NULL keeps the session in memory only; so does a workspace another
+// editor already has open, starting from a copy of it
+Workspace *open_workspace(const char *name);
+
+const HistoryEntry *history_current(const Workspace *ws);
+
+void history_push(Workspace *ws, int size, uint128_t state);
+
+const HistoryEntry *history_undo(Workspace *ws);
+
+const HistoryEntry *history_redo(Workspace *ws);
+
+void workspace_remap(Workspace *ws, SquareMapping from, SquareMapping to);
+
+void workspace_flush(Workspace *ws);
+
+void close_workspace(Workspace *ws);